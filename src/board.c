@@ -329,6 +329,43 @@ int boardDrawnByInsufficientMaterial(Board *board) {
             || (!board->pieces[BISHOP] && popcount(board->pieces[KNIGHT]) <= 2));
 }
 
+int boardHasUpcomingRepetition(Board *board, int height) {
+
+    // Check for a reversible move which returns to an earlier position in
+    // the line. The hash difference to that position must then be one of
+    // the keys in the cuckoo tables, and the path between the squares empty.
+    // Only positions after the root are checked, since a repetition which
+    // involves the positions before the root would need a third occurrence
+
+    const uint64_t occupied = board->colours[WHITE] | board->colours[BLACK];
+    const int end = MIN(height - 1, MIN(board->halfMoveCounter, board->numMoves));
+
+    for (int i = 3; i <= end; i += 2) {
+
+        const uint64_t moveKey = board->hash ^ board->history[board->numMoves - i];
+
+        int slot = cuckooHash1(moveKey);
+        if (CuckooKeys[slot] != moveKey) slot = cuckooHash2(moveKey);
+        if (CuckooKeys[slot] != moveKey) continue;
+
+        const int from = MoveFrom(CuckooMoves[slot]);
+        const int to   = MoveTo(CuckooMoves[slot]);
+
+        if (bitsBetweenMasks(from, to) & occupied)
+            continue;
+
+        // The move must be playable by the side to move. This can fail when a
+        // null move sits between the positions, since the history still has them
+        const int piece = board->squares[from] != EMPTY
+                        ? board->squares[from] : board->squares[to];
+
+        if (pieceColour(piece) == board->turn)
+            return 1;
+    }
+
+    return 0;
+}
+
 uint64_t perft(Board *board, int depth) {
 
     Undo undo[1];
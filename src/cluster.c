@@ -0,0 +1,439 @@
+/*
+  Ethereal is a UCI chess playing engine authored by Andrew Grant.
+  <https://github.com/AndyGrant/Ethereal>     <andrew@grantnet.us>
+
+  Ethereal is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Ethereal is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cluster.h"
+#include "transposition.h"
+#include "uci.h"
+
+#if defined(__linux__)
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct ClusterNode {
+    char name[256], bestmove[16];
+    int socket, connected, searching, depth;
+    uint64_t nodes;
+    FILE *input;
+    pthread_t reader;
+} ClusterNode;
+
+static ClusterNode Nodes[CLUSTER_MAX_NODES];
+static int NodeCount;
+
+static pthread_mutex_t ClusterLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ClusterSignal = PTHREAD_COND_INITIALIZER;
+static pthread_t Exchanger;
+static int Exchanging, Serving;
+
+// Only the options which change what the search finds are shared.
+// The rest describe the machine, and are left to each worker
+static char *SharedOptions[] = {
+    "setoption name Hash value ",
+    "setoption name ContemptDrawPenalty value ",
+    "setoption name ContemptComplexity value ",
+    "setoption name UCI_Chess960 value ",
+};
+
+// The latest setting of each shared option, to be replayed to new workers
+static char SharedValues[sizeof(SharedOptions) / sizeof(SharedOptions[0])][256];
+
+static int sendAll(ClusterNode *node, const void *data, size_t length) {
+
+    // Writes to a node which has gone away fail, rather than raising SIGPIPE
+    for (const char *ptr = data; length; ) {
+        ssize_t sent = send(node->socket, ptr, length, MSG_NOSIGNAL);
+        if (sent <= 0 && errno == EINTR) continue;
+        if (sent <= 0) return node->connected = 0;
+        ptr += sent, length -= sent;
+    }
+
+    return 1;
+}
+
+static void sendBatch(ClusterNode *node, TTExport *entries, int count) {
+
+    char header[64];
+    snprintf(header, sizeof(header), "ttbatch %d\n", count);
+
+    if (sendAll(node, header, strlen(header)))
+        sendAll(node, entries, count * sizeof(TTExport));
+}
+
+static void *clusterReader(void *cargo) {
+
+    // Follow the output of a worker until the connection closes. Batches
+    // of TTEntries are stored as they arrive. The latest depth and nodes
+    // are tracked for reporting, and a bestmove ends the worker's search
+
+    ClusterNode *node = (ClusterNode*) cargo;
+    TTExport entries[CLUSTER_BATCH_SIZE];
+    char line[8192], *ptr;
+
+    while (fgets(line, sizeof(line), node->input) != NULL) {
+
+        if (strStartsWith(line, "ttbatch ")) {
+
+            int count = atoi(line + strlen("ttbatch "));
+
+            if (   count < 0 || count > CLUSTER_BATCH_SIZE
+                || fread(entries, sizeof(TTExport), count, node->input) != (size_t) count)
+                break;
+
+            importTTEntries(entries, count);
+        }
+
+        else if (strStartsWith(line, "info depth ")) {
+            node->depth = atoi(line + strlen("info depth "));
+            if ((ptr = strstr(line, " nodes ")) != NULL)
+                node->nodes = strtoull(ptr + strlen(" nodes "), NULL, 10);
+        }
+
+        else if (strStartsWith(line, "bestmove ")) {
+            pthread_mutex_lock(&ClusterLock);
+            sscanf(line, "bestmove %15s", node->bestmove);
+            node->searching = 0, pthread_cond_broadcast(&ClusterSignal);
+            pthread_mutex_unlock(&ClusterLock);
+        }
+    }
+
+    pthread_mutex_lock(&ClusterLock);
+    node->connected = node->searching = 0;
+    pthread_cond_broadcast(&ClusterSignal);
+    pthread_mutex_unlock(&ClusterLock);
+
+    return NULL;
+}
+
+static void *clusterExchange(void *cargo) {
+
+    // Send a batch of our deepest recent TTEntries to each worker every
+    // interval, until the search ends. Successive batches continue the
+    // scan of the Table from where the last one stopped
+
+    static uint64_t cursor;
+    TTExport entries[CLUSTER_BATCH_SIZE];
+    struct timespec wakeup;
+
+    (void) cargo;
+
+    pthread_mutex_lock(&ClusterLock);
+
+    while (Exchanging) {
+
+        clock_gettime(CLOCK_REALTIME, &wakeup);
+        wakeup.tv_nsec += CLUSTER_INTERVAL_MS * 1000000L;
+        wakeup.tv_sec  += wakeup.tv_nsec / 1000000000L;
+        wakeup.tv_nsec %= 1000000000L;
+
+        while (Exchanging && pthread_cond_timedwait(&ClusterSignal, &ClusterLock, &wakeup) != ETIMEDOUT);
+        if (!Exchanging) break;
+
+        int count = exportTTEntries(entries, CLUSTER_BATCH_SIZE, CLUSTER_MIN_DEPTH, &cursor, CLUSTER_SCAN_SIZE);
+
+        for (int i = 0; i < NodeCount; i++)
+            if (Nodes[i].connected && Nodes[i].searching)
+                sendBatch(&Nodes[i], entries, count);
+    }
+
+    pthread_mutex_unlock(&ClusterLock);
+
+    return NULL;
+}
+
+static int connectNode(ClusterNode *node, char *name) {
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *results;
+    char host[256], *port;
+    int one = 1;
+
+    // Nodes are given as host:port, where the host may be a name or address
+    snprintf(host, sizeof(host), "%s", name);
+    if ((port = strrchr(host, ':')) == NULL) return 0;
+    *port++ = '\0';
+
+    if (getaddrinfo(host, port, &hints, &results)) return 0;
+
+    node->socket = -1;
+    for (struct addrinfo *addr = results; addr != NULL && node->socket == -1; addr = addr->ai_next) {
+
+        if ((node->socket = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) == -1)
+            continue;
+
+        if (connect(node->socket, addr->ai_addr, addr->ai_addrlen))
+            close(node->socket), node->socket = -1;
+    }
+
+    freeaddrinfo(results);
+    if (node->socket == -1) return 0;
+
+    // Commands and batches are small, and should not wait to be combined
+    setsockopt(node->socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    snprintf(node->name, sizeof(node->name), "%s", name);
+    node->input = fdopen(node->socket, "r");
+    node->connected = 1, node->searching = 0;
+    pthread_create(&node->reader, NULL, &clusterReader, node);
+
+    return 1;
+}
+
+int clusterConnect(char *nodes, int megabytes) {
+
+    // Replace any existing workers with those in the comma or space
+    // separated list. Workers are given our Hash size, so that both
+    // sides agree on the bucket which holds each exchanged TTEntry,
+    // followed by any other shared options which have been set
+
+    char list[8192], option[128], *name, *save;
+
+    clusterDisconnect();
+    snprintf(list, sizeof(list), "%s", nodes);
+    snprintf(option, sizeof(option), "setoption name Hash value %d", megabytes);
+
+    for (name = strtok_r(list, ", ", &save); name != NULL; name = strtok_r(NULL, ", ", &save)) {
+
+        if (NodeCount == CLUSTER_MAX_NODES || !connectNode(&Nodes[NodeCount], name)) {
+            printf("info string Cluster unable to connect to %s\n", name);
+            continue;
+        }
+
+        NodeCount++;
+    }
+
+    clusterSend(option);
+
+    // Skip the first shared option, Hash, which was just sent above
+    for (size_t i = 1; i < sizeof(SharedOptions) / sizeof(SharedOptions[0]); i++)
+        if (SharedValues[i][0]) clusterSend(SharedValues[i]);
+
+    return NodeCount;
+}
+
+void clusterDisconnect() {
+
+    // Closing our side ends each worker's UCI loop, and so the worker
+    for (int i = 0; i < NodeCount; i++) {
+        shutdown(Nodes[i].socket, SHUT_RDWR);
+        pthread_join(Nodes[i].reader, NULL);
+        fclose(Nodes[i].input);
+    }
+
+    NodeCount = 0;
+}
+
+void clusterSend(char *str) {
+
+    pthread_mutex_lock(&ClusterLock);
+
+    for (int i = 0; i < NodeCount; i++)
+        if (Nodes[i].connected && sendAll(&Nodes[i], str, strlen(str)))
+            sendAll(&Nodes[i], "\n", 1);
+
+    pthread_mutex_unlock(&ClusterLock);
+}
+
+void clusterSendOption(char *str) {
+
+    // Options are remembered even without workers, for clusterConnect()
+    for (size_t i = 0; i < sizeof(SharedOptions) / sizeof(SharedOptions[0]); i++) {
+        if (strStartsWith(str, SharedOptions[i])) {
+            snprintf(SharedValues[i], sizeof(SharedValues[i]), "%s", str);
+            clusterSend(str);
+        }
+    }
+}
+
+void clusterStartSearch() {
+
+    if (!NodeCount) return;
+
+    // Workers search until we tell them to stop
+    pthread_mutex_lock(&ClusterLock);
+
+    for (int i = 0; i < NodeCount; i++) {
+        Nodes[i].depth = Nodes[i].nodes = 0;
+        Nodes[i].bestmove[0] = '\0';
+        Nodes[i].searching = Nodes[i].connected
+                          && sendAll(&Nodes[i], "go infinite\n", strlen("go infinite\n"));
+    }
+
+    Exchanging = 1;
+    pthread_mutex_unlock(&ClusterLock);
+
+    pthread_create(&Exchanger, NULL, &clusterExchange, NULL);
+}
+
+void clusterStopSearch() {
+
+    struct timespec deadline;
+    uint64_t nodes = 0;
+    int waiting = 1;
+
+    if (!NodeCount) return;
+
+    pthread_mutex_lock(&ClusterLock);
+    Exchanging = 0, pthread_cond_broadcast(&ClusterSignal);
+    pthread_mutex_unlock(&ClusterLock);
+    pthread_join(Exchanger, NULL);
+
+    clusterSend("stop");
+
+    // Give the workers a second to report, so that any batches already
+    // sent to us are stored before the next search. Later batches are
+    // still safe, since imports are serialized against changes to the Table
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 1;
+
+    pthread_mutex_lock(&ClusterLock);
+
+    while (waiting) {
+
+        waiting = 0;
+        for (int i = 0; i < NodeCount; i++)
+            waiting |= Nodes[i].searching;
+
+        if (waiting && pthread_cond_timedwait(&ClusterSignal, &ClusterLock, &deadline) == ETIMEDOUT)
+            break;
+    }
+
+    for (int i = 0; i < NodeCount; i++)
+        nodes += Nodes[i].nodes;
+
+    printf("info string Cluster of %d workers searched %"PRIu64" nodes\n", NodeCount, nodes);
+    pthread_mutex_unlock(&ClusterLock);
+}
+
+void clusterServe(const char *address, int port) {
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    int server, client, one = 1;
+
+    // Wait for a single coordinator, and then use the connection in place
+    // of stdin and stdout, so that the UCI loop serves the coordinator.
+    // The connection is not authenticated, so by default we only listen
+    // on the loopback interface, unless given an address to bind to
+
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Ethereal worker: invalid address %s\n", address);
+        exit(EXIT_FAILURE);
+    }
+
+    if (   (server = socket(AF_INET, SOCK_STREAM, 0)) == -1
+        ||  setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))
+        ||  bind(server, (struct sockaddr*) &addr, sizeof(addr))
+        ||  listen(server, 1)) {
+        perror("Ethereal worker");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "Ethereal worker listening on %s:%d\n", address, port);
+
+    if ((client = accept(server, NULL, NULL)) == -1) {
+        perror("Ethereal worker");
+        exit(EXIT_FAILURE);
+    }
+
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    dup2(client, STDIN_FILENO), dup2(client, STDOUT_FILENO);
+    close(client), close(server);
+    Serving = 1;
+}
+
+int clusterAcceptsCommand(char *str) {
+
+    // A worker takes only the commands a coordinator sends. In particular,
+    // anything which reads or writes files, or makes new connections, is
+    // refused, since the coordinator's connection is not authenticated
+
+    if (!Serving)
+        return 1;
+
+    if (strStartsWith(str, "savehash ") || strStartsWith(str, "loadhash "))
+        return 0;
+
+    if (!strStartsWith(str, "setoption"))
+        return 1;
+
+    for (size_t i = 0; i < sizeof(SharedOptions) / sizeof(SharedOptions[0]); i++)
+        if (strStartsWith(str, SharedOptions[i])) return 1;
+
+    return 0;
+}
+
+void clusterExchangeBatch(int count) {
+
+    // A batch from the coordinator follows the ttbatch command on stdin.
+    // Store it, and reply with a batch of our own. The reply is written
+    // while holding stdout, so it is not split by the search's output
+
+    static uint64_t cursor;
+    TTExport entries[CLUSTER_BATCH_SIZE];
+
+    if (   count < 0 || count > CLUSTER_BATCH_SIZE
+        || fread(entries, sizeof(TTExport), count, stdin) != (size_t) count)
+        return;
+
+    importTTEntries(entries, count);
+    count = exportTTEntries(entries, CLUSTER_BATCH_SIZE, CLUSTER_MIN_DEPTH, &cursor, CLUSTER_SCAN_SIZE);
+
+    flockfile(stdout);
+    printf("ttbatch %d\n", count);
+    fwrite(entries, sizeof(TTExport), count, stdout);
+    fflush(stdout);
+    funlockfile(stdout);
+}
+
+#else
+
+int clusterConnect(char *nodes, int megabytes) {
+    (void) megabytes;
+    if (*nodes) printf("info string Cluster is only supported on Linux\n");
+    return 0;
+}
+
+void clusterDisconnect() {}
+void clusterSend(char *str) { (void) str; }
+void clusterSendOption(char *str) { (void) str; }
+void clusterStartSearch() {}
+void clusterStopSearch() {}
+
+void clusterServe(const char *address, int port) {
+    (void) address, (void) port;
+    fprintf(stderr, "Ethereal worker is only supported on Linux\n");
+    exit(EXIT_FAILURE);
+}
+
+int clusterAcceptsCommand(char *str) { (void) str; return 1; }
+void clusterExchangeBatch(int count) { (void) count; }
+
+#endif
@@ -0,0 +1,46 @@
+/*
+  Ethereal is a UCI chess playing engine authored by Andrew Grant.
+  <https://github.com/AndyGrant/Ethereal>     <andrew@grantnet.us>
+
+  Ethereal is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Ethereal is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "types.h"
+
+// A coordinator runs a Lazy SMP search across several processes, which may
+// be on other machines. Each worker is a normal Ethereal, started with the
+// worker command, which is sent the coordinator's positions and searches.
+// While searching, the coordinator trades batches of deep TTEntries with
+// each worker, which replies to every batch with one of its own
+
+enum {
+    CLUSTER_MAX_NODES   = 64,
+    CLUSTER_BATCH_SIZE  = 1024,  // Most TTEntries sent in a single batch
+    CLUSTER_MIN_DEPTH   = 8,     // Shallowest TTEntry worth sending
+    CLUSTER_SCAN_SIZE   = 16384, // Buckets scanned when building a batch
+    CLUSTER_INTERVAL_MS = 50,    // Time between batches from the coordinator
+};
+
+int clusterConnect(char *nodes, int megabytes);
+void clusterDisconnect();
+void clusterSend(char *str);
+void clusterSendOption(char *str);
+void clusterStartSearch();
+void clusterStopSearch();
+void clusterServe(const char *address, int port);
+int clusterAcceptsCommand(char *str);
+void clusterExchangeBatch(int count);
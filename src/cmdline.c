@@ -16,11 +16,13 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "board.h"
+#include "cluster.h"
 #include "cmdline.h"
 #include "move.h"
 #include "search.h"
@@ -30,6 +32,9 @@
 #include "tuner.h"
 #include "uci.h"
 
+extern int HelperSkipping; // Defined by search.c
+extern int ABDADA;         // Defined by search.c
+
 void handleCommandLine(int argc, char **argv) {
 
     // Benchmarker is being run from the command line
@@ -39,6 +44,13 @@ void handleCommandLine(int argc, char **argv) {
         exit(EXIT_SUCCESS);
     }
 
+    // SMP Benchmarker is being run from the command line
+    // USAGE: ./Ethereal smpbench <depth> <threads> <hash>
+    if (argc > 1 && strEquals(argv[1], "smpbench")) {
+        runSMPBenchmark(argc, argv);
+        exit(EXIT_SUCCESS);
+    }
+
     // Bench is being run from the command line
     // USAGE: ./Ethereal evalbook <book> <depth> <threads> <hash>
     if (argc > 2 && strEquals(argv[1], "evalbook")) {
@@ -46,6 +58,13 @@ void handleCommandLine(int argc, char **argv) {
         exit(EXIT_SUCCESS);
     }
 
+    // Cluster worker is being run from the command line, after which
+    // the UCI loop serves the coordinator which connects to the port.
+    // The worker only listens on the loopback address unless given one
+    // USAGE: ./Ethereal worker <port> <address=127.0.0.1>
+    if (argc > 2 && strEquals(argv[1], "worker"))
+        clusterServe(argc > 3 ? argv[3] : "127.0.0.1", atoi(argv[2]));
+
     // Tuner is being run from the command line
     #ifdef TUNE
         runTuner();
@@ -70,14 +89,18 @@ void runBenchmark(int argc, char **argv) {
     uint16_t bestMoves[256];
     uint16_t ponderMoves[256];
 
-    double time;
+    double time, latency;
     uint64_t totalNodes = 0ull;
 
+#if defined(EVAL_STATS)
+    uint64_t evprobes = 0ull, evhits = 0ull;
+#endif
+
     int depth     = argc > 2 ? atoi(argv[2]) : 13;
     int nthreads  = argc > 3 ? atoi(argv[3]) :  1;
     int megabytes = argc > 4 ? atoi(argv[4]) : 16;
 
-    initTT(megabytes);
+    initTT(megabytes, nthreads);
     time = getRealTime();
     threads = createThreadPool(nthreads);
 
@@ -98,8 +121,31 @@ void runBenchmark(int argc, char **argv) {
         times[i] = getRealTime() - limits.start;
         nodes[i] = nodesSearchedThreadPool(threads);
 
-        clearTT(); // Reset TT between searches
+#if defined(EVAL_STATS)
+        for (int j = 0; j < nthreads; j++)
+            evprobes += threads->pool[j]->evprobes, evhits += threads->pool[j]->evhits;
+#endif
+
+        clearTT(nthreads); // Reset TT between searches
+    }
+
+    time = getRealTime() - time;
+
+    // Measure how long it takes for every thread to reach its first node,
+    // after being woken for a search. Reports of the search are withheld,
+    // so that the time spent writing them is not part of the measurement
+    limits.depthLimit = 1, limits.silent = 1, latency = 0.0;
+    boardFromFEN(&board, Benchmarks[0], 0);
+    for (int i = 0; i < 256; i++) {
+        uint16_t best, ponder;
+        double slowest = 0.0;
+        limits.start = getRealTime();
+        getBestMove(threads, &board, &limits, &best, &ponder);
+        for (int j = 0; j < nthreads; j++)
+            slowest = MAX(slowest, threads->pool[j]->started - threads->pool[j]->woken);
+        latency += slowest;
     }
+    latency = 1000.0 * latency / 256;
 
     printf("\n=================================================================================\n");
 
@@ -118,11 +164,82 @@ void runBenchmark(int argc, char **argv) {
     printf("=================================================================================\n");
 
     // Report the overall statistics
-    time = getRealTime() - time;
+    printf("GO LATENCY: %45.1f us from wakeup to the first node of %d threads\n", latency, nthreads);
+#if defined(EVAL_STATS)
+    printf("EVAL CACHE: %44.2f%% hits from %"PRIu64" probes\n", 100.0 * evhits / MAX(1, evprobes), evprobes);
+#endif
     for (int i = 0; strcmp(Benchmarks[i], ""); i++) totalNodes += nodes[i];
     printf("OVERALL: %53d nodes %8d nps\n", (int)totalNodes, (int)(1000.0f * totalNodes / (time + 1)));
 
-    free(threads);
+#if defined(TT_STATS)
+    uciReportTTStats(threads);
+#endif
+
+    deleteThreadPool(threads);
+}
+
+void runSMPBenchmark(int argc, char **argv) {
+
+    static const char *Benchmarks[] = {
+        #include "bench.csv"
+        ""
+    };
+
+    // Compare the time to reach a depth, and the nodes needed to do so,
+    // between a single thread and a pool of threads, using Lazy SMP with
+    // and without the helpers skipping depths, and then using ABDADA.
+    // Nodes beyond those of the single thread are duplicated work, or
+    // work on lines the single thread never needed. Running this with
+    // 8, 32 and 128 threads shows how each method scales
+
+    Board board;
+    Limits limits = {0};
+    uint16_t best, ponder;
+
+    double times[4] = {0};
+    uint64_t nodes[4] = {0};
+    const char *names[4] = { "single", "no skipping", "skipping", "ABDADA" };
+
+    int depth     = argc > 2 ? atoi(argv[2]) : 12;
+    int nthreads  = argc > 3 ? atoi(argv[3]) :  4;
+    int megabytes = argc > 4 ? atoi(argv[4]) : 16;
+
+    limits.multiPV        = 1;
+    limits.limitedByDepth = 1;
+    limits.depthLimit     = depth;
+
+    for (int run = 0; run < 4; run++) {
+
+        HelperSkipping = run == 2;
+        ABDADA = run == 3;
+        Thread *threads = createThreadPool(run ? nthreads : 1);
+        initTT(megabytes, threads->nthreads);
+
+        for (int i = 0; strcmp(Benchmarks[i], ""); i++) {
+
+            limits.start = getRealTime();
+            boardFromFEN(&board, Benchmarks[i], 0);
+            getBestMove(threads, &board, &limits, &best, &ponder);
+
+            times[run] += getRealTime() - limits.start;
+            nodes[run] += nodesSearchedThreadPool(threads);
+
+            resetThreadPool(threads); clearTT(threads->nthreads);
+        }
+
+        deleteThreadPool(threads);
+    }
+
+    printf("\n=================================================================================\n");
+
+    for (int run = 0; run < 4; run++)
+        printf("SMP [%-11s] %4d threads %10d ms to depth %2d %12"PRIu64" nodes %5.2fx time %5.2fx nodes\n",
+            names[run], run ? nthreads : 1, (int) times[run], depth, nodes[run],
+            times[0] / MAX(1, times[run]), (double) nodes[run] / MAX(1, nodes[0]));
+
+    printf("=================================================================================\n");
+
+    HelperSkipping = ABDADA = 0;
 }
 
 void runEvalBook(int argc, char **argv) {
@@ -143,13 +260,13 @@ void runEvalBook(int argc, char **argv) {
     limits.multiPV = 1;
     limits.limitedByDepth = 1;
     limits.depthLimit = depth;
-    initTT(megabytes);
+    initTT(megabytes, nthreads);
 
     while ((fgets(line, 256, book)) != NULL) {
         limits.start = getRealTime();
         boardFromFEN(&board, line, 0);
         getBestMove(threads, &board, &limits, &best, &ponder);
-        resetThreadPool(threads); clearTT();
+        resetThreadPool(threads); clearTT(nthreads);
         printf("FEN: %s", line);
     }
 
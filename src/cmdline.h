@@ -20,4 +20,5 @@
 
 void handleCommandLine(int argc, char **argv);
 void runBenchmark(int argc, char **argv);
+void runSMPBenchmark(int argc, char **argv);
 void runEvalBook(int argc, char **argv);
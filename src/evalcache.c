@@ -15,22 +15,96 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "board.h"
 #include "evaluate.h"
 #include "thread.h"
 #include "types.h"
+#include "windows.h"
 #include "zobrist.h"
 
+int EvalCacheKB = 512;      // Set by UCI options
+int PKCacheKB   = 1536;     // Set by UCI options
+int SharedEvalCache = 0;    // Set by UCI options
+extern int LargePages;      // Defined by windows.c
+extern int NUMAInterleave;  // Defined by transposition.c
+
+static uint64_t cacheEntries(uint64_t kilobytes, uint64_t entrySize) {
+
+    // Find the largest power of two number of entries within the given size
+    uint64_t entries = 1;
+    while (2 * entries * entrySize <= 1024ull * kilobytes) entries *= 2;
+    return entries;
+}
+
+void initEvalCaches(Thread *thread) {
+
+    // Both caches share a single allocation, which is 2MB using the
+    // default sizes, so that they may be backed by one Huge Page. Smaller
+    // caches use normal pages, since a Huge Page would round them back up
+    // to 2MB, and pages of 1GB would be far larger than the caches. With
+    // a shared Evaluation Cache, the first Thread allocates one table
+    // with the combined size of all of the others, who then refer to it
+
+    const int shared = SharedEvalCache && thread->nthreads > 1;
+    const uint64_t kilobytes = (uint64_t) EvalCacheKB * (shared ? thread->nthreads : 1);
+
+    const uint64_t evsize = shared && thread->index ? 0
+                          : cacheEntries(kilobytes, sizeof(EvalEntry)) * sizeof(EvalEntry);
+    const uint64_t pksize = cacheEntries(PKCacheKB, sizeof(PKEntry)) * sizeof(PKEntry);
+
+    const int pages = evsize + pksize < (2ull << 20) ? PAGES_NORMAL : MIN(LargePages, PAGES_2MB);
+    char *memory = allocPages(evsize + pksize, pages, &thread->cachePages);
+
+    thread->caches     = memory;
+    thread->cachesSize = evsize + pksize;
+    thread->evshared   = shared && thread->index;
+
+    thread->evtable = thread->evshared ? thread->pool[0]->evtable : (EvalEntry*) memory;
+    thread->evmask  = thread->evshared ? thread->pool[0]->evmask : evsize / sizeof(EvalEntry) - 1;
+    thread->pktable = (PKEntry*) (memory + evsize);
+    thread->pkmask  = pksize / sizeof(PKEntry) - 1;
+
+    // The shared table is used by every node, like the Transposition Table
+    if (shared && !thread->index && NUMAInterleave)
+        interleaveMemory(memory, evsize);
+
+    clearEvalCaches(thread);
+}
+
+void deleteEvalCaches(Thread *thread) {
+    freePages(thread->caches, thread->cachesSize, thread->cachePages);
+}
+
+void clearEvalCaches(Thread *thread) {
+
+    // Shared Evaluation Caches are cleared by their owner
+    if (!thread->evshared)
+        memset(thread->evtable, 0, sizeof(EvalEntry) * (thread->evmask + 1));
+
+    memset(thread->pktable, 0, sizeof(PKEntry) * (thread->pkmask + 1));
+}
+
+uint64_t evalCachesBytes(Thread *thread) {
+    return pagesAllocated(thread->cachesSize, thread->cachePages);
+}
+
 int getCachedEvaluation(Thread *thread, Board *board, int *eval) {
 
     EvalEntry eve;
     uint64_t key1, key2;
 
+    // Entries are single words, verified against the entire key, so
+    // the table may be shared between threads without any locking
     key1 =  board->turn ? board->hash ^ ZobristTurnKey : board->hash;
-    eve  =  thread->evtable[key1 & EVAL_CACHE_MASK];
+    eve  =  __atomic_load_n(&thread->evtable[key1 & thread->evmask], __ATOMIC_RELAXED);
     key2 = (eve & ~0xFFFF) | (key1 & 0xFFFF);
 
+#if defined(EVAL_STATS)
+    thread->evprobes++, thread->evhits += key1 == key2;
+#endif
+
     *eval = (int16_t)((uint16_t)(eve & 0xFFFF));
     *eval = Tempo + (board->turn == WHITE ? *eval : -*eval);
     return key1 == key2;
@@ -38,17 +112,26 @@ int getCachedEvaluation(Thread *thread, Board *board, int *eval) {
 
 void storeCachedEvaluation(Thread *thread, Board *board, int eval) {
     uint64_t key1 =  board->turn ? board->hash ^ ZobristTurnKey : board->hash;
-    thread->evtable[key1 & EVAL_CACHE_MASK] = (key1 & ~0xFFFF) | (uint16_t)((int16_t)eval);
+    __atomic_store_n(&thread->evtable[key1 & thread->evmask], (key1 & ~0xFFFF) | (uint16_t)((int16_t)eval), __ATOMIC_RELAXED);
+}
+
+void prefetchCachedEvaluation(Thread *thread, uint64_t hash, int turn) {
+    uint64_t key1 = turn ? hash ^ ZobristTurnKey : hash;
+    __builtin_prefetch(&thread->evtable[key1 & thread->evmask]);
+}
+
+void prefetchCachedPawnKingEval(Thread *thread, uint64_t pkhash) {
+    __builtin_prefetch(&thread->pktable[pkhash & thread->pkmask]);
 }
 
 
 PKEntry* getCachedPawnKingEval(Thread *thread, Board *board) {
-    PKEntry *pke = &thread->pktable[board->pkhash & PK_CACHE_MASK];
-    return pke->pkhash == board->pkhash ? pke : NULL;
+    PKEntry *pke = &thread->pktable[board->pkhash & thread->pkmask];
+    return pke->pkkey == (uint32_t) (board->pkhash >> 32) ? pke : NULL;
 }
 
 void storeCachedPawnKingEval(Thread *thread, Board *board, uint64_t passed, int eval, int safetyw, int safetyb) {
-    PKEntry *pke = &thread->pktable[board->pkhash & PK_CACHE_MASK];
-    *pke = (PKEntry) {board->pkhash, passed, eval, safetyw, safetyb};
+    PKEntry *pke = &thread->pktable[board->pkhash & thread->pkmask];
+    *pke = (PKEntry) {passed, (uint32_t) (board->pkhash >> 32), eval, safetyw, safetyb};
 }
 
@@ -20,27 +20,26 @@
 #include "board.h"
 #include "types.h"
 
-enum {
-    EVAL_CACHE_KEY_SIZE = 16,
-    EVAL_CACHE_MASK     = 0xFFFF,
-    EVAL_CACHE_SIZE     = 1 << EVAL_CACHE_KEY_SIZE,
-};
-
-enum {
-    PK_CACHE_KEY_SIZE   = 16,
-    PK_CACHE_MASK       = 0xFFFF,
-    PK_CACHE_SIZE       = 1 << PK_CACHE_KEY_SIZE,
-};
+// Building with -DEVAL_STATS counts the probes and hits of the Evaluation
+// Cache for each search thread, which are reported at the end of a bench
 
 typedef uint64_t EvalEntry;
-typedef EvalEntry EvalTable[EVAL_CACHE_SIZE];
 
-struct PKEntry { uint64_t pkhash, passed; int eval, safetyw, safetyb; };
-typedef PKEntry PKTable[PK_CACHE_SIZE];
+// Pawn King entries keep only the upper half of the hash as a key, since
+// the index is taken from the lower bits, which packs them into 24 bytes
+struct PKEntry { uint64_t passed; uint32_t pkkey; int eval, safetyw, safetyb; };
+
+void initEvalCaches(Thread *thread);
+void deleteEvalCaches(Thread *thread);
+void clearEvalCaches(Thread *thread);
+uint64_t evalCachesBytes(Thread *thread);
 
 int getCachedEvaluation(Thread *thread, Board *board, int *eval);
 void storeCachedEvaluation(Thread *thread, Board *board, int eval);
 
+void prefetchCachedEvaluation(Thread *thread, uint64_t hash, int turn);
+void prefetchCachedPawnKingEval(Thread *thread, uint64_t pkhash);
+
 PKEntry* getCachedPawnKingEval(Thread *thread, Board *board);
 void storeCachedPawnKingEval(Thread *thread, Board *board, uint64_t passed, int eval, int safetyw, int safetyb);
 
@@ -31,19 +31,19 @@ void updateHistoryHeuristics(Thread *thread, uint16_t *moves, int length, int de
     uint16_t bestMove = moves[length-1];
 
     // Extract information from last move
-    uint16_t counter = thread->moveStack[thread->height-1];
-    int cmPiece = thread->pieceStack[thread->height-1];
+    uint16_t counter = thread->stack[thread->height-1].move;
+    int cmPiece = thread->stack[thread->height-1].piece;
     int cmTo = MoveTo(counter);
 
     // Extract information from two moves ago
-    uint16_t follow = thread->moveStack[thread->height-2];
-    int fmPiece = thread->pieceStack[thread->height-2];
+    uint16_t follow = thread->stack[thread->height-2].move;
+    int fmPiece = thread->stack[thread->height-2].piece;
     int fmTo = MoveTo(follow);
 
     // Update Killer Moves (Avoid duplicates)
-    if (thread->killers[thread->height][0] != bestMove) {
-        thread->killers[thread->height][1] = thread->killers[thread->height][0];
-        thread->killers[thread->height][0] = bestMove;
+    if (thread->stack[thread->height].killers[0] != bestMove) {
+        thread->stack[thread->height].killers[1] = thread->stack[thread->height].killers[0];
+        thread->stack[thread->height].killers[0] = bestMove;
     }
 
     // Update Counter Moves (BestMove refutes the previous move)
@@ -91,18 +91,21 @@ void updateHistoryHeuristics(Thread *thread, uint16_t *moves, int length, int de
 void updateKillerMoves(Thread *thread, uint16_t move) {
 
     // Avoid saving the same Killer Move twice
-    if (thread->killers[thread->height][0] == move) return;
+    if (thread->stack[thread->height].killers[0] == move) return;
 
-    thread->killers[thread->height][1] = thread->killers[thread->height][0];
-    thread->killers[thread->height][0] = move;
+    thread->stack[thread->height].killers[1] = thread->stack[thread->height].killers[0];
+    thread->stack[thread->height].killers[0] = move;
 }
 
 
 void updateCaptureHistories(Thread *thread, uint16_t best, uint16_t *moves, int length, int depth) {
 
+    // Captures fill the back of the tried list in search(), so they are
+    // given in reverse, and are walked backwards to update in tried order
+
     const int bonus = MIN(depth * depth, HistoryMax);
 
-    for (int i = 0; i < length; i++) {
+    for (int i = length - 1; i >= 0; i--) {
 
         const int to = MoveTo(moves[i]);
         const int from = MoveFrom(moves[i]);
@@ -158,13 +161,13 @@ void getHistory(Thread *thread, uint16_t move, int *hist, int *cmhist, int *fmhi
     int piece = pieceType(thread->board.squares[from]);
 
     // Extract information from last move
-    uint16_t counter = thread->moveStack[thread->height-1];
-    int cmPiece = thread->pieceStack[thread->height-1];
+    uint16_t counter = thread->stack[thread->height-1].move;
+    int cmPiece = thread->stack[thread->height-1].piece;
     int cmTo = MoveTo(counter);
 
     // Extract information from two moves ago
-    uint16_t follow = thread->moveStack[thread->height-2];
-    int fmPiece = thread->pieceStack[thread->height-2];
+    uint16_t follow = thread->stack[thread->height-2].move;
+    int fmPiece = thread->stack[thread->height-2].piece;
     int fmTo = MoveTo(follow);
 
     // Set basic Butterfly history
@@ -182,13 +185,13 @@ void getHistory(Thread *thread, uint16_t move, int *hist, int *cmhist, int *fmhi
 void getHistoryScores(Thread *thread, uint16_t *moves, int *scores, int start, int length) {
 
     // Extract information from last move
-    uint16_t counter = thread->moveStack[thread->height-1];
-    int cmPiece = thread->pieceStack[thread->height-1];
+    uint16_t counter = thread->stack[thread->height-1].move;
+    int cmPiece = thread->stack[thread->height-1].piece;
     int cmTo = MoveTo(counter);
 
     // Extract information from two moves ago
-    uint16_t follow = thread->moveStack[thread->height-2];
-    int fmPiece = thread->pieceStack[thread->height-2];
+    uint16_t follow = thread->stack[thread->height-2].move;
+    int fmPiece = thread->stack[thread->height-2].piece;
     int fmTo = MoveTo(follow);
 
     for (int i = start; i < start + length; i++) {
@@ -214,13 +217,13 @@ void getHistoryScores(Thread *thread, uint16_t *moves, int *scores, int start, i
 void getRefutationMoves(Thread *thread, uint16_t *killer1, uint16_t *killer2, uint16_t *counter) {
 
     // Extract information from last move
-    uint16_t previous = thread->moveStack[thread->height-1];
-    int cmPiece = thread->pieceStack[thread->height-1];
+    uint16_t previous = thread->stack[thread->height-1].move;
+    int cmPiece = thread->stack[thread->height-1].piece;
     int cmTo = MoveTo(previous);
 
     // Set Killer Moves by height
-    *killer1 = thread->killers[thread->height][0];
-    *killer2 = thread->killers[thread->height][1];
+    *killer1 = thread->stack[thread->height].killers[0];
+    *killer2 = thread->stack[thread->height].killers[1];
 
     // Set Counter Move if one exists
     if (previous == NONE_MOVE || previous == NULL_MOVE) *counter = NONE_MOVE;
@@ -24,12 +24,14 @@
 #include "attacks.h"
 #include "bitboards.h"
 #include "board.h"
+#include "evalcache.h"
 #include "evaluate.h"
 #include "masks.h"
 #include "move.h"
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
+#include "transposition.h"
 #include "types.h"
 #include "uci.h"
 #include "zobrist.h"
@@ -51,22 +53,33 @@ int castleRookTo(int king, int rook) {
 
 int apply(Thread *thread, Board *board, uint16_t move) {
 
+    // Predict the keys of the child position, and begin loading its TT
+    // bucket and cached evaluations while the move is being applied
+    const uint64_t hash = hashAfterMove(board, move);
+    const uint64_t pkhash = pkhashAfterMove(board, move);
+
+    prefetchTTEntry(hash);
+    prefetchCachedEvaluation(thread, hash, !board->turn);
+    if (pkhash != board->pkhash) prefetchCachedPawnKingEval(thread, pkhash);
+
     // NULL moves are only tried when legal
     if (move == NULL_MOVE) {
-        thread->moveStack[thread->height] = NULL_MOVE;
-        applyNullMove(board, &thread->undoStack[thread->height]);
+        thread->stack[thread->height].move = NULL_MOVE;
+        applyNullMove(board, &thread->stack[thread->height].undo);
+        assert(board->hash == hash && board->pkhash == pkhash);
     }
 
     else {
 
         // Track some move information for history lookups
-        thread->moveStack[thread->height] = move;
-        thread->pieceStack[thread->height] = pieceType(board->squares[MoveFrom(move)]);
+        thread->stack[thread->height].move = move;
+        thread->stack[thread->height].piece = pieceType(board->squares[MoveFrom(move)]);
 
         // Apply the move and reject if illegal
-        applyMove(board, move, &thread->undoStack[thread->height]);
+        applyMove(board, move, &thread->stack[thread->height].undo);
+        assert(board->hash == hash && board->pkhash == pkhash);
         if (!moveWasLegal(board))
-            return revertMove(board, move, &thread->undoStack[thread->height]), 0;
+            return revertMove(board, move, &thread->stack[thread->height].undo), 0;
     }
 
     // Advance the Stack before updating
@@ -81,11 +94,11 @@ int apply(Thread *thread, Board *board, uint16_t move) {
 void applyLegal(Thread *thread, Board *board, uint16_t move) {
 
     // Track some move information for history lookups
-    thread->moveStack[thread->height] = move;
-    thread->pieceStack[thread->height] = pieceType(board->squares[MoveFrom(move)]);
+    thread->stack[thread->height].move = move;
+    thread->stack[thread->height].piece = pieceType(board->squares[MoveFrom(move)]);
 
     // Assumed that this move is legal
-    applyMove(board, move, &thread->undoStack[thread->height]);
+    applyMove(board, move, &thread->stack[thread->height].undo);
     assert(moveWasLegal(board));
 
     // Advance the Stack before updating
@@ -349,11 +362,11 @@ void applyNullMove(Board *board, Undo *undo) {
 void revert(Thread *thread, Board *board, uint16_t move) {
 
     if (move == NULL_MOVE)
-        revertNullMove(board, &thread->undoStack[--thread->height]);
+        revertNullMove(board, &thread->stack[--thread->height].undo);
     else
-        revertMove(board, move, &thread->undoStack[--thread->height]);
+        revertMove(board, move, &thread->stack[--thread->height].undo);
 
-    if (thread->pknnchanged[thread->height])
+    if (thread->stack[thread->height].pknnchanged)
         thread->pknndepth -= 1;
 }
 
@@ -469,37 +482,105 @@ int legalMoveCount(Board * board) {
     return genAllLegalMoves(board, moves);
 }
 
-int moveExaminedByMultiPV(Thread *thread, uint16_t move) {
+static void initRootMove(Thread *thread, int index, uint16_t move) {
 
-    // Check to see if this move was already selected as the
-    // best move in a previous iteration of this search depth
+    // Only the length of the PV is reset, to avoid writing the whole line
+    RootMove *const rootMove = &thread->rootMoves[index];
 
-    for (int i = 0; i < thread->multiPV; i++)
-        if (thread->bestMoves[i] == move)
-            return 1;
+    static_assert(sizeof(RootMove) == 64, "RootMove must fill a single cache line");
 
-    return 0;
+    rootMove->move  = move, rootMove->pvLength = 0;
+    rootMove->score = rootMove->previousScore = -MATE;
+    rootMove->nodes = 0ull;
+
+    thread->rootIndex[MoveFrom(move)][MoveTo(move)] = index;
 }
 
-int moveIsInRootMoves(Thread *thread, uint16_t move) {
+void initRootMoves(Thread *thread, Board *board, Limits *limits) {
 
-    // We do two things: 1) Check to make sure we are not using a move which
-    // has been flagged as excluded thanks to Syzygy probing. 2) Check to see
-    // if we are doing a "go searchmoves <>"  command, in which case we have
-    // to limit our search to the provided moves.
+    // Build the list of legal moves at the root, once for each search.
+    // Moves flagged as excluded thanks to Syzygy probing, and when doing
+    // a "go searchmoves <>" command any moves not provided, are placed
+    // after the rootMoveCount moves which are to be searched
 
-    for (int i = 0; i < MAX_MOVES; i++)
-        if (move == thread->limits->excludedMoves[i])
-            return 0;
+    int size, excluded = 0;
+    uint16_t moves[MAX_MOVES], skipped[MAX_MOVES];
 
-    if (!thread->limits->limitedByMoves)
-        return 1;
+    thread->rootMoveCount = 0;
+    size = genAllLegalMoves(board, moves);
 
-    for (int i = 0; i < MAX_MOVES; i++)
-        if (move == thread->limits->searchMoves[i])
-            return 1;
+    for (int i = 0; i < size; i++) {
 
-    return 0;
+        int exclude = 0, include = !limits->limitedByMoves;
+
+        for (int j = 0; j < MAX_MOVES; j++) {
+            exclude |= moves[i] == limits->excludedMoves[j];
+            include |= moves[i] == limits->searchMoves[j];
+        }
+
+        if (exclude || !include) skipped[excluded++] = moves[i];
+        else initRootMove(thread, thread->rootMoveCount++, moves[i]);
+    }
+
+    for (int i = 0; i < excluded; i++)
+        initRootMove(thread, thread->rootMoveCount + i, skipped[i]);
+
+    thread->rootMoveLegal = thread->rootMoveCount + excluded;
+}
+
+void copyRootMoves(Thread *thread, Thread *source) {
+
+    // Take the same list of RootMoves, but none of the search results
+
+    thread->rootMoveCount = source->rootMoveCount;
+    thread->rootMoveLegal = source->rootMoveLegal;
+
+    for (int i = 0; i < source->rootMoveLegal; i++)
+        initRootMove(thread, i, source->rootMoves[i].move);
+}
+
+RootMove* findRootMove(Thread *thread, uint16_t move) {
+
+    // Locate a move in the list of legal moves at the root. Moves are
+    // indexed by their squares, which only promotions have in common, so
+    // a scan is left for those, and for moves which are not legal at all
+
+    const int index = thread->rootIndex[MoveFrom(move)][MoveTo(move)];
+
+    if (index < thread->rootMoveLegal && thread->rootMoves[index].move == move)
+        return &thread->rootMoves[index];
+
+    for (int i = 0; i < thread->rootMoveLegal; i++)
+        if (thread->rootMoves[i].move == move)
+            return &thread->rootMoves[i];
+
+    return NULL;
+}
+
+int rootMoveIsSkipped(Thread *thread, RootMove *rootMove) {
+
+    // The RootMoves of lines already selected by MultiPV during this
+    // iteration are kept at the front of the list, and those which are
+    // not to be searched at all are kept at the end of the list
+
+    const int index = rootMove - thread->rootMoves;
+    return index < thread->multiPV || index >= thread->rootMoveCount;
+}
+
+void selectRootMove(Thread *thread, uint16_t move) {
+
+    // Swap the best move of the current MultiPV line into the front
+    // of the list, after the moves of the previous lines
+
+    RootMove *const rootMove = findRootMove(thread, move);
+    RootMove *const selected = &thread->rootMoves[thread->multiPV];
+
+    if (rootMove != NULL && rootMove != selected) {
+        RootMove temp = *rootMove;
+        *rootMove = *selected, *selected = temp;
+        thread->rootIndex[MoveFrom(rootMove->move)][MoveTo(rootMove->move)] = rootMove - thread->rootMoves;
+        thread->rootIndex[MoveFrom(selected->move)][MoveTo(selected->move)] = selected - thread->rootMoves;
+    }
 }
 
 int moveIsTactical(Board *board, uint16_t move) {
@@ -54,8 +54,11 @@ void revertMove(Board *board, uint16_t move, Undo *undo);
 void revertNullMove(Board *board, Undo *undo);
 
 int legalMoveCount(Board * board);
-int moveExaminedByMultiPV(Thread *thread, uint16_t move);
-int moveIsInRootMoves(Thread *thread, uint16_t move);
+void initRootMoves(Thread *thread, Board *board, Limits *limits);
+void copyRootMoves(Thread *thread, Thread *source);
+RootMove* findRootMove(Thread *thread, uint16_t move);
+int rootMoveIsSkipped(Thread *thread, RootMove *rootMove);
+void selectRootMove(Thread *thread, uint16_t move);
 int moveIsTactical(Board *board, uint16_t move);
 int moveEstimatedValue(Board *board, uint16_t move);
 int moveBestCaseValue(Board *board);
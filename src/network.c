@@ -150,7 +150,7 @@ void updatePKNetworkIndices(Thread *thread, int changes, int indexes[3], int sig
     float *layer1Neurons_d1 = thread->pknnlayer1[thread->pknndepth];
     float *layer1Neurons    = thread->pknnlayer1[++thread->pknndepth];
 
-    thread->pknnchanged[thread->height-1] = 1;
+    thread->stack[thread->height-1].pknnchanged = 1;
     memcpy(layer1Neurons, layer1Neurons_d1, sizeof(float) * PKNETWORK_LAYER1);
 
     for (int j = 0; j < changes; j++)
@@ -165,11 +165,11 @@ void updatePKNetworkAfterMove(Thread *thread, uint16_t move) {
     int type   =  MoveType(move);
     int colour = !thread->board.turn;
     int moved  =  pieceType(thread->board.squares[to]);
-    int taken  =  pieceType(thread->undoStack[thread->height-1].capturePiece);
+    int taken  =  pieceType(thread->stack[thread->height-1].undo.capturePiece);
 
     int changes = 0, indexes[3], signs[3];
 
-    thread->pknnchanged[thread->height-1] = 0;
+    thread->stack[thread->height-1].pknnchanged = 0;
 
     if (move == NULL_MOVE)
         return;
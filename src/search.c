@@ -29,6 +29,7 @@
 #include "attacks.h"
 #include "bitboards.h"
 #include "board.h"
+#include "cluster.h"
 #include "evaluate.h"
 #include "pyrrhic/tbprobe.h"
 #include "history.h"
@@ -48,6 +49,40 @@ int LMRTable[64][64];      // Late Move Reductions
 volatile int ABORT_SIGNAL; // Global ABORT flag for threads
 volatile int IS_PONDERING; // Global PONDER flag for threads
 volatile int ANALYSISMODE; // Whether to make some changes for Analysis
+int HelperSkipping = 0;    // Set by UCI options
+int ABDADA = 0;            // Set by UCI options
+
+// Depth skipping schedule for the helpers. Helper i skips depths in runs
+// of SkipSize[i], offset by SkipPhase[i], so that the helpers are spread
+// across different depths instead of all searching the same iteration
+
+static const int SkipSize[]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+static const int SkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+// ABDADA marks the moves being searched by each thread in a shared table,
+// keyed by the position and the move. Other threads defer those moves,
+// after their first, until the rest of their moves have been searched.
+// Marks left behind by an aborted search only cause needless deferrals
+
+enum { BUSY_TABLE_SIZE = 1 << 15 };
+static uint64_t BusyTable[BUSY_TABLE_SIZE];
+
+static uint64_t busyKey(Board *board, uint16_t move) {
+    return board->hash ^ (move * 0x9E3779B97F4A7C15ull);
+}
+
+static int moveIsBusy(uint64_t key) {
+    return __atomic_load_n(&BusyTable[key & (BUSY_TABLE_SIZE - 1)], __ATOMIC_RELAXED) == key;
+}
+
+static void markBusy(uint64_t key) {
+    __atomic_store_n(&BusyTable[key & (BUSY_TABLE_SIZE - 1)], key, __ATOMIC_RELAXED);
+}
+
+static void clearBusy(uint64_t key) {
+    __atomic_compare_exchange_n(&BusyTable[key & (BUSY_TABLE_SIZE - 1)], &key, 0,
+                                0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
 
 void initSearch() {
 
@@ -60,35 +95,104 @@ void initSearch() {
 void getBestMove(Thread *threads, Board *board, Limits *limits, uint16_t *best, uint16_t *ponder) {
 
     SearchInfo info = {0};
-    pthread_t pthreads[threads->nthreads];
 
-    // Allow Syzygy to refine the move list for optimal results
-    if (!limits->limitedByMoves && limits->multiPV == 1)
+    // Build the RootMoves, shared by the Threads, and cap our
+    // MultiPV search based on the moves which are left to search
+    initRootMoves(threads, board, limits);
+    limits->multiPV = MAX(1, MIN(limits->multiPV, threads->rootMoveCount));
+
+    // Allow Syzygy to refine the move list for optimal results. In
+    // AnalysisMode, Syzygy may exclude the moves which spoil the WDL,
+    // so the RootMoves are built again without them, and MultiPV recapped
+    if (!limits->limitedByMoves && limits->multiPV == 1) {
+
         if (tablebasesProbeDTZ(board, limits, best, ponder))
             return;
 
+        if (ANALYSISMODE) {
+            initRootMoves(threads, board, limits);
+            limits->multiPV = MAX(1, MIN(limits->multiPV, threads->rootMoveCount));
+        }
+    }
+
     // Minor house keeping for starting a search
     updateTT(); // Table has an age component
     ABORT_SIGNAL = 0; // Otherwise Threads will exit
+    memset(BusyTable, 0, sizeof(BusyTable) * (ABDADA && threads->nthreads > 1));
     initTimeManagment(&info, limits);
     newSearchThreadPool(threads, board, limits, &info);
 
-    // Create a new thread for each of the helpers and reuse the current
-    // thread for the main thread, which avoids some overhead and saves
-    // us from having the current thread eating CPU time while waiting
-    for (int i = 1; i < threads->nthreads; i++)
-        pthread_create(&pthreads[i], NULL, &iterativeDeepening, &threads[i]);
-    iterativeDeepening((void*) &threads[0]);
+    // Any workers in a cluster search alongside our own threads
+    clusterStartSearch();
+
+    // Wake each of the sleeping Threads, including the main thread,
+    // which searches on the pool thread that first touched its memory
+    startSearchThreadPool(threads);
+    waitMainThreadPool(threads);
 
     // When the main thread exits it should signal for the helpers to
-    // shutdown. Wait until all helpers have finished before moving on
+    // stop. Wait until all helpers have finished before moving on
     ABORT_SIGNAL = 1;
-    for (int i = 1; i < threads->nthreads; i++)
-        pthread_join(pthreads[i], NULL);
+    waitHelpersThreadPool(threads);
+    clusterStopSearch();
 
     // The main thread will update SearchInfo with results
     *best = info.bestMoves[info.depth];
     *ponder = info.ponderMoves[info.depth];
+
+    // Helpers have their say when searching a single line, provided
+    // that any of the Threads were able to complete an iteration
+    if (threads->nthreads > 1 && limits->multiPV == 1) {
+        Thread *const thread = selectBestThread(threads);
+        if (thread != NULL) *best = thread->bestMoves[0], *ponder = thread->ponderMoves[0];
+    }
+}
+
+Thread* selectBestThread(Thread *threads) {
+
+    // Each Thread votes for the best move of its last completed iteration,
+    // weighted by both the depth of the iteration and by how much better
+    // than the worst of the threads its score was. Shorter mates, or
+    // shorter tablebase wins, are always taken over the vote. Without
+    // any completed iterations, there is nothing to vote on, and NULL
+
+    Thread *best = threads->pool[0];
+    int minValue = MATE;
+    uint64_t votes[threads->nthreads];
+
+    for (int i = 0; i < threads->nthreads; i++)
+        if (threads->pool[i]->completed)
+            minValue = MIN(minValue, threads->pool[i]->values[0]);
+
+    for (int i = 0; i < threads->nthreads; i++) {
+
+        votes[i] = 0;
+
+        for (int j = 0; j < threads->nthreads; j++)
+            if (threads->pool[j]->completed && threads->pool[j]->bestMoves[0] == threads->pool[i]->bestMoves[0])
+                votes[i] += (uint64_t) (threads->pool[j]->values[0] - minValue + 14) * threads->pool[j]->completed;
+    }
+
+    for (int i = 1; i < threads->nthreads; i++) {
+
+        Thread *const thread = threads->pool[i];
+
+        if (!thread->completed) continue;
+
+        if (!best->completed)
+            best = thread;
+
+        else if (abs(best->values[0]) >= TBWIN_IN_MAX) {
+            if (thread->values[0] > best->values[0])
+                best = thread;
+        }
+
+        else if (   thread->values[0] >= TBWIN_IN_MAX
+                 || (thread->values[0] > -TBWIN_IN_MAX && votes[i] > votes[best->index]))
+            best = thread;
+    }
+
+    return best->completed ? best : NULL;
 }
 
 void* iterativeDeepening(void *vthread) {
@@ -101,9 +205,13 @@ void* iterativeDeepening(void *vthread) {
     // Begin tracking incremental NN updates
     initPKNetworkCollector(thread);
 
-    // Bind when we expect to deal with NUMA
-    if (thread->nthreads > 8)
-        bindThisThread(thread->index);
+#if defined(TT_STATS)
+    // Count TT usage for this thread alone
+    attachTTStats(&thread->ttstats);
+#endif
+
+    // Note when we reach our first node, to measure the cost of waking
+    thread->started = getPreciseTime();
 
     // Perform iterative deepening until exit conditions
     for (thread->depth = 1; thread->depth < MAX_PLY; thread->depth++) {
@@ -111,9 +219,23 @@ void* iterativeDeepening(void *vthread) {
         // If we abort to here, we stop searching
         if (setjmp(thread->jbuffer)) break;
 
+        // Optionally spread the helpers out across the depths
+        if (HelperSkipping && !mainThread) {
+            const int i = (thread->index - 1) % 20;
+            if (((thread->depth + thread->board.numMoves + SkipPhase[i]) / SkipSize[i]) % 2)
+                continue;
+        }
+
+        // Keep the scores of the last iteration, to be replaced by this one
+        for (int i = 0; i < thread->rootMoveCount; i++) {
+            thread->rootMoves[i].previousScore = thread->rootMoves[i].score;
+            thread->rootMoves[i].score = -MATE, thread->rootMoves[i].pvLength = 0;
+        }
+
         // Perform a search for the current depth for each requested line of play
         for (thread->multiPV = 0; thread->multiPV < limits->multiPV; thread->multiPV++)
             aspirationWindow(thread);
+        thread->completed = thread->depth;
 
         // Helper threads need not worry about time and search info updates
         if (!mainThread) continue;
@@ -143,9 +265,9 @@ void* iterativeDeepening(void *vthread) {
 
 void aspirationWindow(Thread *thread) {
 
-    PVariation *const pv = &thread->pv;
+    PVariation *const pv = &thread->pvtable[0];
     const int multiPV    = thread->multiPV;
-    const int mainThread = thread->index == 0;
+    const int reporting  = thread->index == 0 && !thread->limits->silent;
 
     int value, depth = thread->depth;
     int alpha = -MATE, beta = MATE, delta = WindowSize;
@@ -159,16 +281,17 @@ void aspirationWindow(Thread *thread) {
     while (1) {
 
         // Perform a search and consider reporting results
-        value = search(thread, pv, alpha, beta, MAX(1, depth));
-        if (   (mainThread && value > alpha && value < beta)
-            || (mainThread && elapsedTime(thread->info) >= WindowTimerMS))
-            uciReport(thread->threads, alpha, beta, value);
+        value = search(thread, alpha, beta, MAX(1, depth));
+        if (   (reporting && value > alpha && value < beta)
+            || (reporting && elapsedTime(thread->info) >= WindowTimerMS))
+            uciReport(thread->pool[0], alpha, beta, value);
 
         // Search returned a result within our window
         if (value > alpha && value < beta) {
             thread->values[multiPV]      = value;
             thread->bestMoves[multiPV]   = pv->line[0];
             thread->ponderMoves[multiPV] = pv->length > 1 ? pv->line[1] : NONE_MOVE;
+            selectRootMove(thread, pv->line[0]);
             return;
         }
 
@@ -190,28 +313,39 @@ void aspirationWindow(Thread *thread) {
     }
 }
 
-int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
+int search(Thread *thread, int alpha, int beta, int depth) {
 
     const int PvNode   = (alpha != beta - 1);
     const int RootNode = (thread->height == 0);
     Board *const board = &thread->board;
 
+    // Lines are kept in a triangular table, where each node takes the
+    // line of its height, and copies up the line of the next height
+    PVariation *const pv  = &thread->pvtable[thread->height];
+    PVariation *const lpv = pv + 1;
+
+    // Moves are picked and tracked using the frame for this height
+    SearchFrame *const frame = &thread->frames[thread->height];
+    MovePicker *const movePicker = &frame->movePicker;
+    uint16_t *const tried = frame->tried;
+    DeferredMove *const deferredMoves = thread->deferred ? thread->deferred[thread->height] : NULL;
+
     unsigned tbresult;
     int hist = 0, cmhist = 0, fmhist = 0;
-    int quietsSeen = 0, quietsPlayed = 0, capturesPlayed = 0, played = 0;
+    int quietsSeen = 0, quietsPlayed = 0, capturesPlayed = 0, played = 0, overflowed = 0;
+    int deferring, deferred = 0, deferredIdx = 0;
     int ttHit, ttValue = 0, ttEval = VALUE_NONE, ttDepth = 0, ttBound = 0;
     int R, newDepth, rAlpha, rBeta, oldAlpha = alpha;
-    int inCheck, isQuiet, improving, extension, singular, skipQuiets = 0;
+    int inCheck, isQuiet, improving, extension, singular, stage, skipQuiets = 0;
     int eval, value = -MATE, best = -MATE, futilityMargin, seeMargin[2];
     uint16_t move, ttMove = NONE_MOVE, bestMove = NONE_MOVE;
-    uint16_t quietsTried[MAX_MOVES], capturesTried[MAX_MOVES];
-    MovePicker movePicker;
-    PVariation lpv;
+    uint64_t busy = 0, rootNodes = 0;
+    RootMove *rootMove = NULL;
 
     // Step 1. Quiescence Search. Perform a search using mostly tactical
     // moves to reach a more stable position for use as a static evaluation
     if (depth <= 0 && !board->kingAttackers)
-        return qsearch(thread, pv, alpha, beta);
+        return qsearch(thread, alpha, beta);
 
     // Prefetch TT as early as reasonable
     prefetchTTEntry(board->hash);
@@ -239,6 +373,13 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
         // material. Add variance to the draw score, to avoid blindness to 3-fold lines
         if (boardIsDrawn(board, thread->height)) return 1 - (thread->nodes & 2);
 
+        // Upcoming Repetition Detection. If we have a reversible move which would
+        // repeat a position from earlier in the line, we are guaranteed a draw
+        if (alpha < 0 && boardHasUpcomingRepetition(board, thread->height)) {
+            alpha = oldAlpha = 1 - (thread->nodes & 2);
+            if (alpha >= beta) return alpha;
+        }
+
         // Check to see if we have exceeded the maxiumum search draft
         if (thread->height >= MAX_PLY)
             return evaluateBoard(thread, board);
@@ -302,7 +443,7 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
     inCheck = !!board->kingAttackers;
 
     // Save a history of the static evaluations
-    eval = thread->evalStack[thread->height]
+    eval = thread->stack[thread->height].eval
          = ttEval != VALUE_NONE ? ttEval : evaluateBoard(thread, board);
 
     // Futility Pruning Margin
@@ -313,11 +454,11 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
     seeMargin[1] = SEEQuietMargin * depth;
 
     // Improving if our static eval increased in the last move
-    improving = thread->height >= 2 && eval > thread->evalStack[thread->height-2];
+    improving = thread->height >= 2 && eval > thread->stack[thread->height-2].eval;
 
     // Reset Killer moves for our children
-    thread->killers[thread->height+1][0] = NONE_MOVE;
-    thread->killers[thread->height+1][1] = NONE_MOVE;
+    thread->stack[thread->height+1].killers[0] = NONE_MOVE;
+    thread->stack[thread->height+1].killers[1] = NONE_MOVE;
 
     // ------------------------------------------------------------------------
     // All elo estimates as of Ethereal 11.80, @ 12s+0.12 @ 1.275mnps
@@ -341,15 +482,15 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
         && !inCheck
         &&  eval >= beta
         &&  depth >= NullMovePruningDepth
-        &&  thread->moveStack[thread->height-1] != NULL_MOVE
-        &&  thread->moveStack[thread->height-2] != NULL_MOVE
+        &&  thread->stack[thread->height-1].move != NULL_MOVE
+        &&  thread->stack[thread->height-2].move != NULL_MOVE
         &&  boardHasNonPawnMaterial(board, board->turn)
         && (!ttHit || !(ttBound & BOUND_UPPER) || ttValue >= beta)) {
 
         R = 4 + depth / 6 + MIN(3, (eval - beta) / 200);
 
         apply(thread, board, NULL_MOVE);
-        value = -search(thread, &lpv, -beta, -beta+1, depth-R);
+        value = -search(thread, -beta, -beta+1, depth-R);
         revert(thread, board, NULL_MOVE);
 
         if (value >= beta) return beta;
@@ -365,19 +506,19 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
 
         // Try tactical moves which maintain rBeta
         rBeta = MIN(beta + ProbCutMargin, MATE - MAX_PLY - 1);
-        initNoisyMovePicker(&movePicker, thread, rBeta - eval);
-        while ((move = selectNextMove(&movePicker, board, 1)) != NONE_MOVE) {
+        initNoisyMovePicker(movePicker, thread, rBeta - eval);
+        while ((move = selectNextMove(movePicker, board, 1)) != NONE_MOVE) {
 
             // Apply move, skip if move is illegal
             if (!apply(thread, board, move)) continue;
 
             // For high depths, verify the move first with a depth one search
             if (depth >= 2 * ProbCutDepth)
-                value = -search(thread, &lpv, -rBeta, -rBeta+1, 1);
+                value = -search(thread, -rBeta, -rBeta+1, 1);
 
             // For low depths, or after the above, verify with a reduced search
             if (depth < 2 * ProbCutDepth || value >= rBeta)
-                value = -search(thread, &lpv, -rBeta, -rBeta+1, depth-4);
+                value = -search(thread, -rBeta, -rBeta+1, depth-4);
 
             // Revert the board state
             revert(thread, board, move);
@@ -387,14 +528,41 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
         }
     }
 
+    // Only defer moves in ABDADA when other threads could be searching
+    deferring = deferredMoves != NULL && !RootNode && depth >= ABDADADepth;
+
     // Step 10. Initialize the Move Picker and being searching through each
-    // move one at a time, until we run out or a move generates a cutoff
-    initMovePicker(&movePicker, thread, ttMove);
-    while ((move = selectNextMove(&movePicker, board, skipQuiets)) != NONE_MOVE) {
+    // move one at a time, until we run out or a move generates a cutoff.
+    // Any moves deferred by ABDADA are searched once the picker is done
+    initMovePicker(movePicker, thread, ttMove);
+    while (   (move = selectNextMove(movePicker, board, skipQuiets)) != NONE_MOVE
+           || (deferredIdx < deferred && (move = deferredMoves[deferredIdx++].move))) {
+
+        // Deferred moves are judged by the stage they were first picked in
+        stage = deferredIdx ? deferredMoves[deferredIdx-1].stage : movePicker->stage;
+
+        // MultiPV, searchmoves, and Syzygy may limit our search options.
+        // Illegal moves are not RootMoves, and are rejected by apply()
+        if (   RootNode
+            && (rootMove = findRootMove(thread, move)) != NULL
+            &&  rootMoveIsSkipped(thread, rootMove))
+            continue;
 
-        // MultiPV and searchmoves may limit our search options
-        if (RootNode && moveExaminedByMultiPV(thread, move)) continue;
-        if (RootNode &&    !moveIsInRootMoves(thread, move)) continue;
+        // Step 10A. ABDADA. After searching our first move, defer any move
+        // which another thread is searching. When searching the deferred
+        // moves, respect any decision since then to skip the quiet moves
+        if (deferring) {
+
+            busy = busyKey(board, move);
+
+            if (!deferredIdx && played && moveIsBusy(busy)) {
+                deferredMoves[deferred++] = (DeferredMove) { move, stage };
+                continue;
+            }
+
+            if (deferredIdx && skipQuiets && !moveIsTactical(board, move))
+                continue;
+        }
 
         // For quiet moves we fetch various history scores
         if ((isQuiet = !moveIsTactical(board, move))) {
@@ -432,25 +600,25 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
 
             // Step 11D (~8 elo). Counter Move Pruning. Moves with poor counter
             // move history are pruned at near leaf nodes of the search.
-            if (   movePicker.stage > STAGE_COUNTER_MOVE
+            if (   stage > STAGE_COUNTER_MOVE
                 && cmhist < CounterMoveHistoryLimit[improving]
                 && depth - R <= CounterMovePruningDepth[improving])
                 continue;
 
             // Step 11E (~1.5 elo). Follow Up Move Pruning. Moves with poor
             // follow up move history are pruned at near leaf nodes of the search.
-            if (   movePicker.stage > STAGE_COUNTER_MOVE
+            if (   stage > STAGE_COUNTER_MOVE
                 && fmhist < FollowUpMoveHistoryLimit[improving]
                 && depth - R <= FollowUpMovePruningDepth[improving])
                 continue;
         }
 
         // Step 12 (~42 elo). Static Exchange Evaluation Pruning. Prune moves which fail
-        // to beat a depth dependent SEE threshold. The use of movePicker.stage
+        // to beat a depth dependent SEE threshold. The use of the picker's stage
         // is a speedup, which assumes that good noisy moves have a positive SEE
         if (    best > -MATE_IN_MAX
             &&  depth <= SEEPruningDepth
-            &&  movePicker.stage > STAGE_GOOD_NOISY
+            &&  stage > STAGE_GOOD_NOISY
             && !staticExchangeEvaluation(board, move, seeMargin[isQuiet]))
             continue;
 
@@ -458,9 +626,16 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
         if (!apply(thread, board, move))
             continue;
 
+        // Positions with more than MAX_TRIED legal moves can only be given
+        // by FEN, and simply stop recording moves once the list is full
         played += 1;
-        if (isQuiet) quietsTried[quietsPlayed++] = move;
-        else capturesTried[capturesPlayed++] = move;
+        if (quietsPlayed + capturesPlayed == MAX_TRIED) overflowed = 1;
+        else if (isQuiet) tried[quietsPlayed++] = move;
+        else tried[MAX_TRIED - ++capturesPlayed] = move;
+        rootNodes = thread->nodes;
+
+        // Let the other threads know to defer this move
+        if (deferring) markBusy(busy);
 
         // The UCI spec allows us to output information about the current move
         // that we are going to search. We only do this from the main thread,
@@ -480,7 +655,7 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
         // extend for any position where our King is checked. We also selectivly extend moves
         // with very strong continuation histories, so long as they are along the PV line
 
-        extension = singular ? singularity(thread, &movePicker, ttValue, depth, beta)
+        extension = singular ? singularity(thread, movePicker, ttValue, depth, beta)
                   : inCheck || (isQuiet && PvNode && cmhist > HistexLimit && fmhist > HistexLimit);
 
         newDepth = depth + (extension && !RootNode);
@@ -489,8 +664,9 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
         // If this happens, and the rBeta used is greater than beta, then we have multiple moves
         // which appear to beat beta at a reduced depth. singularity() sets the stage to STAGE_DONE
 
-        if (movePicker.stage == STAGE_DONE) {
+        if (singular && movePicker->stage == STAGE_DONE) {
             revert(thread, board, move);
+            if (deferring) clearBusy(busy);
             return MAX(ttValue - depth, -MATE);
         }
 
@@ -508,7 +684,7 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
             R += inCheck && pieceType(board->squares[MoveTo(move)]) == KING;
 
             // Reduce for Killers and Counters
-            R -= movePicker.stage < STAGE_QUIET;
+            R -= stage < STAGE_QUIET;
 
             // Adjust based on history scores
             R -= MAX(-2, MIN(2, (hist + cmhist + fmhist) / 5000));
@@ -521,24 +697,39 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
         // Step 16A. If we triggered the LMR conditions (which we know by the value of R),
         // then we will perform a reduced search on the null alpha window, as we have no
         // expectation that this move will be worth looking into deeper
-        if (R != 1) value = -search(thread, &lpv, -alpha-1, -alpha, newDepth-R);
+        if (R != 1) value = -search(thread, -alpha-1, -alpha, newDepth-R);
 
         // Step 16B. There are two situations in which we will search again on a null window,
         // but without a depth reduction R. First, if the LMR search happened, and failed
         // high, secondly, if we did not try an LMR search, and this is not the first move
         // we have tried in a PvNode, we will research with the normally reduced depth
         if ((R != 1 && value > alpha) || (R == 1 && !(PvNode && played == 1)))
-            value = -search(thread, &lpv, -alpha-1, -alpha, newDepth-1);
+            value = -search(thread, -alpha-1, -alpha, newDepth-1);
 
         // Step 16C. Finally, if we are in a PvNode and a move beat alpha while being
         // search on a reduced depth, we will search again on the normal window. Also,
         // if we did not perform Step 15B, we will search for the first time on the
         // normal window. This happens only for the first move in a PvNode
         if (PvNode && (played == 1 || value > alpha))
-            value = -search(thread, &lpv, -beta, -alpha, newDepth-1);
+            value = -search(thread, -beta, -alpha, newDepth-1);
 
         // Revert the board state
         revert(thread, board, move);
+        if (deferring) clearBusy(busy);
+
+        // Account for the work spent on each move at the root, and keep
+        // the score and PV of the first move and of any that raise alpha
+        if (RootNode && rootMove != NULL) {
+
+            rootMove->nodes += thread->nodes - rootNodes;
+
+            if (played == 1 || value > alpha) {
+                rootMove->score = value;
+                rootMove->pvLength = MIN(ROOT_PV_LENGTH, 1 + lpv->length);
+                rootMove->pv[0] = move;
+                memcpy(rootMove->pv + 1, lpv->line, sizeof(uint16_t) * (rootMove->pvLength - 1));
+            }
+        }
 
         // Step 17. Update search stats for the best move and its value. Update
         // our lower bound (alpha) if exceeded, and also update the PV in that case
@@ -551,9 +742,9 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
                 alpha = value;
 
                 // Copy our child's PV and prepend this move to it
-                pv->length = 1 + lpv.length;
+                pv->length = 1 + lpv->length;
                 pv->line[0] = move;
-                memcpy(pv->line + 1, lpv.line, sizeof(uint16_t) * lpv.length);
+                memcpy(pv->line + 1, lpv->line, sizeof(uint16_t) * lpv->length);
 
                 // Search failed high
                 if (alpha >= beta) break;
@@ -573,12 +764,13 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
 
     // Step 19 (~760 elo). Update History counters on a fail high for a quiet move.
     // We also update Capture History Heuristics, which augment or replace MVV-LVA.
+    // A fail high is on the last move played, which is missing if the list is full
 
-    if (best >= beta && !moveIsTactical(board, bestMove))
-        updateHistoryHeuristics(thread, quietsTried, quietsPlayed, depth);
+    if (best >= beta && !overflowed && !moveIsTactical(board, bestMove))
+        updateHistoryHeuristics(thread, tried, quietsPlayed, depth);
 
-    if (best >= beta)
-        updateCaptureHistories(thread, bestMove, capturesTried, capturesPlayed, depth);
+    if (best >= beta && !overflowed)
+        updateCaptureHistories(thread, bestMove, &tried[MAX_TRIED - capturesPlayed], capturesPlayed, depth);
 
     // Step 20. Store results of search into the Transposition Table. We do
     // not overwrite the Root entry from the first line of play we examined
@@ -591,15 +783,16 @@ int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth) {
     return best;
 }
 
-int qsearch(Thread *thread, PVariation *pv, int alpha, int beta) {
+int qsearch(Thread *thread, int alpha, int beta) {
 
     Board *const board = &thread->board;
+    PVariation *const pv  = &thread->pvtable[thread->height];
+    PVariation *const lpv = pv + 1;
+    MovePicker *const movePicker = &thread->frames[thread->height].movePicker;
 
     int eval, value, best;
     int ttHit, ttValue = 0, ttEval = VALUE_NONE, ttDepth = 0, ttBound = 0;
     uint16_t move, ttMove = NONE_MOVE;
-    MovePicker movePicker;
-    PVariation lpv;
 
     // Prefetch TT as early as reasonable
     prefetchTTEntry(board->hash);
@@ -638,7 +831,7 @@ int qsearch(Thread *thread, PVariation *pv, int alpha, int beta) {
     }
 
     // Save a history of the static evaluations
-    eval = thread->evalStack[thread->height]
+    eval = thread->stack[thread->height].eval
          = ttEval != VALUE_NONE ? ttEval : evaluateBoard(thread, board);
 
     // Step 5. Eval Pruning. If a static evaluation of the board will
@@ -657,12 +850,12 @@ int qsearch(Thread *thread, PVariation *pv, int alpha, int beta) {
     // Step 7. Move Generation and Looping. Generate all tactical moves
     // and return those which are winning via SEE, and also strong enough
     // to beat the margin computed in the Delta Pruning step found above
-    initNoisyMovePicker(&movePicker, thread, MAX(1, alpha - eval - QSSeeMargin));
-    while ((move = selectNextMove(&movePicker, board, 1)) != NONE_MOVE) {
+    initNoisyMovePicker(movePicker, thread, MAX(1, alpha - eval - QSSeeMargin));
+    while ((move = selectNextMove(movePicker, board, 1)) != NONE_MOVE) {
 
         // Search the next ply if the move is legal
         if (!apply(thread, board, move)) continue;
-        value = -qsearch(thread, &lpv, -beta, -alpha);
+        value = -qsearch(thread, -beta, -alpha);
         revert(thread, board, move);
 
         // Improved current value
@@ -674,9 +867,9 @@ int qsearch(Thread *thread, PVariation *pv, int alpha, int beta) {
                 alpha = value;
 
                 // Update the Principle Variation
-                pv->length = 1 + lpv.length;
+                pv->length = 1 + lpv->length;
                 pv->line[0] = move;
-                memcpy(pv->line + 1, lpv.line, sizeof(uint16_t) * lpv.length);
+                memcpy(pv->line + 1, lpv->line, sizeof(uint16_t) * lpv->length);
             }
         }
 
@@ -788,10 +981,12 @@ int singularity(Thread *thread, MovePicker *mp, int ttValue, int depth, int beta
     int skipQuiets = 0, quiets = 0, tacticals = 0;
     int value = -MATE, rBeta = MAX(ttValue - depth, -MATE);
 
-    MovePicker movePicker;
-    PVariation lpv; lpv.length = 0;
     Board *const board = &thread->board;
 
+    // The frame for this height holds the MovePicker of the node
+    // being tested, so the singular search keeps its own picker
+    MovePicker movePicker;
+
     // Table move was already applied
     revert(thread, board, mp->tableMove);
 
@@ -803,7 +998,7 @@ int singularity(Thread *thread, MovePicker *mp, int ttValue, int depth, int beta
 
         // Perform a reduced depth search on a null rbeta window
         if (!apply(thread, board, move)) continue;
-        value = -search(thread, &lpv, -rBeta-1, -rBeta, depth / 2 - 1);
+        value = -search(thread, -rBeta-1, -rBeta, depth / 2 - 1);
         revert(thread, board, move);
 
         // Move failed high, thus mp->tableMove is not singular
@@ -20,6 +20,7 @@
 
 #include <stdint.h>
 
+#include "movepicker.h"
 #include "types.h"
 
 struct SearchInfo {
@@ -34,12 +35,49 @@ struct PVariation {
     int length;
 };
 
+// Each Thread keeps a frame for each ply of the search, holding what a
+// node needs while searching its moves. Frames are cache line aligned,
+// and reused by every node of the same height, rather than being put on
+// the stack for each call of search() and qsearch(). No reachable position
+// has more than 218 legal moves, so the list holds that many, with quiets
+// filling it from the front, and captures from the back, until it is full
+
+enum { MAX_TRIED = 218 };
+
+struct SearchFrame {
+    ALIGN64 MovePicker movePicker;
+    uint16_t tried[MAX_TRIED];
+};
+
+// Moves deferred by ABDADA are searched after the Move Picker is done, so
+// each keeps the stage it was picked in, for pruning and reductions
+
+struct DeferredMove {
+    uint16_t move;
+    uint8_t stage;
+};
+
+// Each Thread keeps its own RootMoves, with the score and PV each move
+// had in this iteration and the last, and the nodes spent searching it.
+// The PVs are only kept for reporting, so the first moves are enough,
+// which lets each RootMove fill a single cache line
+
+enum { ROOT_PV_LENGTH = 20 };
+
+struct RootMove {
+    uint16_t move, pvLength;
+    int score, previousScore;
+    uint64_t nodes;
+    uint16_t pv[ROOT_PV_LENGTH];
+};
+
 void initSearch();
 void getBestMove(Thread *threads, Board *board, Limits *limits, uint16_t *best, uint16_t *ponder);
+Thread* selectBestThread(Thread *threads);
 void* iterativeDeepening(void *vthread);
 void aspirationWindow(Thread *thread);
-int search(Thread *thread, PVariation *pv, int alpha, int beta, int depth);
-int qsearch(Thread *thread, PVariation *pv, int alpha, int beta);
+int search(Thread *thread, int alpha, int beta, int depth);
+int qsearch(Thread *thread, int alpha, int beta);
 int staticExchangeEvaluation(Board *board, uint16_t move, int threshold);
 int singularity(Thread *thread, MovePicker *mp, int ttValue, int depth, int beta);
 
@@ -87,5 +125,7 @@ static const int HistexLimit = 10000;
 static const int QSSeeMargin = 110;
 static const int QSDeltaMargin = 150;
 
+static const int ABDADADepth = 5;
+
 static const int SingularQuietLimit = 6;
 static const int SingularTacticalLimit = 3;
@@ -22,33 +22,176 @@
 #include "board.h"
 #include "evaluate.h"
 #include "history.h"
+#include "move.h"
 #include "search.h"
 #include "thread.h"
+#include "time.h"
 #include "transposition.h"
 #include "types.h"
+#include "windows.h"
 
 // Default contempt values, UCI options can set them to other values
 int ContemptDrawPenalty = 0;
 int ContemptComplexity  = 0;
 
+extern int LargePages; // Defined by windows.c
+extern int ABDADA;     // Defined by search.c
+
+typedef struct ThreadPoolStart {
+    Thread **pool;
+    int nthreads, claimed, started;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} ThreadPoolStart;
+
+static Thread* initThread(Thread **pool, int index, int nthreads) {
+
+    // Each Thread is a separate allocation, made and first touched by the
+    // thread which will search with it, so that no page is shared with
+    // another Thread. A Thread is far smaller than a Huge Page, most of
+    // which would go unused, so only normal pages are used, rounded to 4KB
+
+    int pages;
+    Thread *const thread = allocPages(sizeof(Thread), PAGES_NORMAL, &pages);
+
+    // Zero all but the frames, which are always written before being read.
+    // Frames of the heights which are never reached are then never touched,
+    // and so are never backed by memory
+    char *const frames = (char*) thread->frames, *const end = frames + sizeof(thread->frames);
+    memset(thread, 0, frames - (char*) thread);
+    memset(end, 0, (char*) (thread + 1) - end);
+
+    // Offset stacks so the root position may look backwards
+    thread->stack = &(thread->_stack[STACK_OFFSET]);
+
+    // Threads will know of each other
+    thread->index    = index;
+    thread->pool     = pool;
+    thread->nthreads = nthreads;
+    thread->pages    = pages;
+    pool[index]      = thread;
+
+    // Caches are sized by UCI options, and are touched by this thread
+    initEvalCaches(thread);
+
+    // Moves deferred by ABDADA get a list for each height, only when used
+    if (ABDADA && nthreads > 1)
+        thread->deferred = calloc(MAX_PLY + 1, sizeof(*thread->deferred));
+
+    pthread_mutex_init(&thread->lock, NULL);
+    pthread_cond_init(&thread->wakeup, NULL);
+
+    return thread;
+}
+
+static void *idleLoop(void *cargo) {
+
+    ThreadPoolStart *start = (ThreadPoolStart*) cargo;
+
+    pthread_mutex_lock(&start->lock);
+    const int index = start->claimed++;
+    pthread_mutex_unlock(&start->lock);
+
+    // Bind before touching any of our Thread, so that its pages, and
+    // our hot per-thread tables, are placed on the local NUMA node
+    if (start->nthreads > 8)
+        bindThisThread(index);
+
+    Thread *const thread = initThread(start->pool, index, start->nthreads);
+    thread->pthread = pthread_self();
+
+    // Let createThreadPool() know that we are ready. We must not
+    // access the ThreadPoolStart at all after releasing the lock
+    pthread_mutex_lock(&start->lock);
+    start->started++;
+    pthread_cond_signal(&start->ready);
+    pthread_mutex_unlock(&start->lock);
+
+    pthread_mutex_lock(&thread->lock);
+
+    while (true) {
+
+        // Sleep until there is either a search or a request to exit
+        while (!thread->searching && !thread->exiting)
+            pthread_cond_wait(&thread->wakeup, &thread->lock);
+
+        if (thread->exiting) break;
+
+        pthread_mutex_unlock(&thread->lock);
+        iterativeDeepening(thread);
+        pthread_mutex_lock(&thread->lock);
+
+        // Let getBestMove() know that we have finished
+        thread->searching = false;
+        pthread_cond_signal(&thread->wakeup);
+    }
+
+    pthread_mutex_unlock(&thread->lock);
+
+    return NULL;
+}
+
+static void waitThreadPoolStart(ThreadPoolStart *start, int count) {
+
+    // Wait until the given number of Threads have been initialized
+    pthread_mutex_lock(&start->lock);
+    while (start->started < count)
+        pthread_cond_wait(&start->ready, &start->lock);
+    pthread_mutex_unlock(&start->lock);
+}
+
 Thread* createThreadPool(int nthreads) {
 
-    Thread *threads = calloc(nthreads, sizeof(Thread));
+    pthread_t pthread;
+    Thread **pool = malloc(nthreads * sizeof(Thread*));
+
+    ThreadPoolStart start = { .pool = pool, .nthreads = nthreads };
+    pthread_mutex_init(&start.lock, NULL);
+    pthread_cond_init(&start.ready, NULL);
+
+    // Threads are created once, and then sleep between searches. Each
+    // initializes its own Thread, so that the memory is first touched
+    // by the thread which will search with it. The main thread is set up
+    // before the helpers, since it owns any shared Evaluation Cache
+
+    pthread_create(&pthread, NULL, &idleLoop, &start);
+    waitThreadPoolStart(&start, 1);
+
+    for (int i = 1; i < nthreads; i++)
+        pthread_create(&pthread, NULL, &idleLoop, &start);
+    waitThreadPoolStart(&start, nthreads);
+
+    pthread_cond_destroy(&start.ready);
+    pthread_mutex_destroy(&start.lock);
+
+    return pool[0];
+}
+
+void deleteThreadPool(Thread *threads) {
+
+    Thread **const pool = threads->pool;
+    const int nthreads = threads->nthreads;
 
+    // Wake each of the sleeping Threads with the exit flag set
     for (int i = 0; i < nthreads; i++) {
 
-        // Offset stacks so the root position may look backwards
-        threads[i].evalStack  = &(threads[i]._evalStack[STACK_OFFSET]);
-        threads[i].moveStack  = &(threads[i]._moveStack[STACK_OFFSET]);
-        threads[i].pieceStack = &(threads[i]._pieceStack[STACK_OFFSET]);
+        pthread_mutex_lock(&pool[i]->lock);
+        pool[i]->exiting = true;
+        pthread_cond_signal(&pool[i]->wakeup);
+        pthread_mutex_unlock(&pool[i]->lock);
 
-        // Threads will know of each other
-        threads[i].index = i;
-        threads[i].threads = threads;
-        threads[i].nthreads = nthreads;
+        pthread_join(pool[i]->pthread, NULL);
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        deleteEvalCaches(pool[i]);
+        free(pool[i]->deferred);
+        pthread_cond_destroy(&pool[i]->wakeup);
+        pthread_mutex_destroy(&pool[i]->lock);
+        freePages(pool[i], sizeof(Thread), pool[i]->pages);
     }
 
-    return threads;
+    free(pool);
 }
 
 void resetThreadPool(Thread *threads) {
@@ -59,15 +202,20 @@ void resetThreadPool(Thread *threads) {
 
     for (int i = 0; i < threads->nthreads; i++) {
 
-        memset(&threads[i].evtable, 0, sizeof(EvalTable));
-        memset(&threads[i].pktable, 0, sizeof(PKTable));
+        Thread *const thread = threads->pool[i];
 
-        memset(&threads[i].killers, 0, sizeof(KillerTable));
-        memset(&threads[i].cmtable, 0, sizeof(CounterMoveTable));
+        clearEvalCaches(thread);
 
-        memset(&threads[i].history, 0, sizeof(HistoryTable));
-        memset(&threads[i].chistory, 0, sizeof(CaptureHistoryTable));
-        memset(&threads[i].continuation, 0, sizeof(ContinuationTable));
+        memset(&thread->_stack, 0, sizeof(thread->_stack));
+        memset(&thread->cmtable, 0, sizeof(CounterMoveTable));
+
+        memset(&thread->history, 0, sizeof(HistoryTable));
+        memset(&thread->chistory, 0, sizeof(CaptureHistoryTable));
+        memset(&thread->continuation, 0, sizeof(ContinuationTable));
+
+#if defined(TT_STATS)
+        memset(&thread->ttstats, 0, sizeof(TTStats));
+#endif
     }
 }
 
@@ -82,20 +230,96 @@ void newSearchThreadPool(Thread *threads, Board *board, Limits *limits, SearchIn
 
     for (int i = 0; i < threads->nthreads; i++) {
 
-        threads[i].limits = limits;
-        threads[i].info   = info;
+        Thread *const thread = threads->pool[i];
+
+        thread->limits = limits;
+        thread->info   = info;
+
+        thread->height    = 0;
+        thread->completed = 0;
+        thread->pknndepth = 0;
+
+        thread->nodes     = 0ull;
+        thread->tbhits    = 0ull;
 
-        threads[i].height    = 0;
-        threads[i].pknndepth = 0;
+#if defined(EVAL_STATS)
+        thread->evprobes  = 0ull;
+        thread->evhits    = 0ull;
+#endif
 
-        threads[i].nodes     = 0ull;
-        threads[i].tbhits    = 0ull;
+        memcpy(&thread->board, board, sizeof(Board));
+        thread->contempt = board->turn == WHITE ? contempt : -contempt;
 
-        memcpy(&threads[i].board, board, sizeof(Board));
-        threads[i].contempt = board->turn == WHITE ? contempt : -contempt;
+        // The RootMoves are built once by getBestMove(), and then copied
+        // to each helper, since the main thread reorders them for MultiPV
+        if (i != 0) copyRootMoves(thread, threads);
     }
 }
 
+void startSearchThreadPool(Thread *threads) {
+
+    // Note the time of the wakeup, which each Thread compares
+    // against the time at which it reaches its first node
+    const double woken = getPreciseTime();
+    for (int i = 0; i < threads->nthreads; i++)
+        threads->pool[i]->woken = woken;
+
+    // Wake each of the Threads to begin searching
+    for (int i = 0; i < threads->nthreads; i++) {
+        pthread_mutex_lock(&threads->pool[i]->lock);
+        threads->pool[i]->searching = true;
+        pthread_cond_signal(&threads->pool[i]->wakeup);
+        pthread_mutex_unlock(&threads->pool[i]->lock);
+    }
+}
+
+static void waitThread(Thread *thread) {
+
+    // Wait until the Thread has gone back to sleep
+    pthread_mutex_lock(&thread->lock);
+    while (thread->searching)
+        pthread_cond_wait(&thread->wakeup, &thread->lock);
+    pthread_mutex_unlock(&thread->lock);
+}
+
+void waitMainThreadPool(Thread *threads) {
+    waitThread(threads->pool[0]);
+}
+
+void waitHelpersThreadPool(Thread *threads) {
+    for (int i = 1; i < threads->nthreads; i++)
+        waitThread(threads->pool[i]);
+}
+
+uint64_t threadBytes(Thread *thread) {
+
+    // The allocation of a Thread, which is rounded up to whole pages
+    return pagesAllocated(sizeof(Thread), thread->pages);
+}
+
+uint64_t memoryThreadPool(Thread *threads) {
+
+    // Each Thread, as well as its separately allocated evaluation caches
+    uint64_t bytes = 0ull;
+
+    for (int i = 0; i < threads->nthreads; i++)
+        bytes += threadBytes(threads->pool[i]) + evalCachesBytes(threads->pool[i]);
+
+    return bytes;
+}
+
+uint64_t hugePagesBackedThreadPool(Thread *threads) {
+
+    // Bytes of the evaluation caches, the only part of the Threads
+    // which may use Huge Pages, that are backed by Huge Pages
+    uint64_t bytes = 0ull;
+
+    for (int i = 0; i < threads->nthreads; i++)
+        bytes += hugePagesBacked(threads->pool[i]->caches, evalCachesBytes(threads->pool[i]));
+
+    return bytes;
+}
+
 uint64_t nodesSearchedThreadPool(Thread *threads) {
 
     // Sum up the node counters across each Thread. Threads have
@@ -104,7 +328,7 @@ uint64_t nodesSearchedThreadPool(Thread *threads) {
     uint64_t nodes = 0ull;
 
     for (int i = 0; i < threads->nthreads; i++)
-        nodes += threads[i].nodes;
+        nodes += threads->pool[i]->nodes;
 
     return nodes;
 }
@@ -117,7 +341,7 @@ uint64_t tbhitsThreadPool(Thread *threads) {
     uint64_t tbhits = 0ull;
 
     for (int i = 0; i < threads->nthreads; i++)
-        tbhits += threads[i].tbhits;
+        tbhits += threads->pool[i]->tbhits;
 
     return tbhits;
 }
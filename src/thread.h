@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -31,13 +32,25 @@
 
 enum {
     STACK_OFFSET = 4,
-    STACK_SIZE = MAX_PLY + STACK_OFFSET
+    STACK_SIZE = MAX_PLY + STACK_OFFSET + 1
+};
+
+// Each ply has one SearchStack, grouping the fields which a node uses
+// together, so that they share a single cache line. The stack is offset
+// so that the root position may look backwards, and covers one ply past
+// MAX_PLY, where the killers of the deepest children are reset
+
+struct SearchStack {
+    Undo undo;
+    int eval, piece;
+    uint16_t move, killers[2];
+    bool pknnchanged;
 };
 
 struct Thread {
 
     Board board;
-    PVariation pv;
+    PVariation pvtable[MAX_PLY+1];
     Limits *limits;
     SearchInfo *info;
 
@@ -45,21 +58,34 @@ struct Thread {
     uint16_t bestMoves[MAX_MOVES];
     uint16_t ponderMoves[MAX_MOVES];
 
+    int rootMoveCount, rootMoveLegal;
+    RootMove rootMoves[MAX_MOVES];
+    uint8_t rootIndex[SQUARE_NB][SQUARE_NB];
+
     int contempt, pknndepth;
-    int depth, seldepth, height;
+    int depth, completed, seldepth, height;
     uint64_t nodes, tbhits;
+    double woken, started;
 
-    int *evalStack, _evalStack[STACK_SIZE];
-    uint16_t *moveStack, _moveStack[STACK_SIZE];
-    int *pieceStack, _pieceStack[STACK_SIZE];
+    SearchStack *stack;
+    ALIGN64 SearchStack _stack[STACK_SIZE];
 
-    Undo undoStack[STACK_SIZE];
-    bool pknnchanged[STACK_SIZE];
+    EvalEntry *evtable;
+    PKEntry *pktable;
+    uint64_t evmask, pkmask;
 
-    ALIGN64 EvalTable evtable;
-    ALIGN64 PKTable pktable;
+#if defined(EVAL_STATS)
+    uint64_t evprobes, evhits;
+#endif
+
+    void *caches;
+    uint64_t cachesSize;
+    int cachePages;
+    bool evshared;
+
+    ALIGN64 SearchFrame frames[MAX_PLY+1];
+    DeferredMove (*deferred)[MAX_MOVES];
 
-    ALIGN64 KillerTable killers;
     ALIGN64 CounterMoveTable cmtable;
 
     ALIGN64 HistoryTable history;
@@ -68,14 +94,30 @@ struct Thread {
 
     ALIGN64 float pknnlayer1[STACK_SIZE][PKNETWORK_LAYER1];
 
-    int index, nthreads;
-    Thread *threads;
+#if defined(TT_STATS)
+    TTStats ttstats;
+#endif
+
+    int index, nthreads, pages;
+    Thread **pool;
     jmp_buf jbuffer;
+
+    pthread_t pthread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool searching, exiting;
 };
 
 
 Thread* createThreadPool(int nthreads);
+void deleteThreadPool(Thread *threads);
 void resetThreadPool(Thread *threads);
 void newSearchThreadPool(Thread *threads, Board *board, Limits *limits, SearchInfo *info);
+void startSearchThreadPool(Thread *threads);
+void waitMainThreadPool(Thread *threads);
+void waitHelpersThreadPool(Thread *threads);
+uint64_t threadBytes(Thread *thread);
+uint64_t memoryThreadPool(Thread *threads);
+uint64_t hugePagesBackedThreadPool(Thread *threads);
 uint64_t nodesSearchedThreadPool(Thread *threads);
 uint64_t tbhitsThreadPool(Thread *threads);
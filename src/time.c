@@ -41,6 +41,22 @@ double getRealTime() {
 #endif
 }
 
+double getPreciseTime() {
+
+    // Like getRealTime(), but keeping the fractions of a millisecond,
+    // for measuring intervals which are far shorter than a millisecond
+
+#if defined(_WIN32) || defined(_WIN64)
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count), QueryPerformanceFrequency(&frequency);
+    return 1000.0 * count.QuadPart / frequency.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return 1000.0 * tv.tv_sec + tv.tv_usec / 1000.0;
+#endif
+}
+
 double elapsedTime(SearchInfo *info) {
     return getRealTime() - info->startTime;
 }
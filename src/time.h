@@ -27,6 +27,7 @@
 #include "types.h"
 
 double getRealTime();
+double getPreciseTime();
 double elapsedTime(SearchInfo *info);
 void initTimeManagment(SearchInfo *info, Limits *limits);
 void updateTimeManagment(SearchInfo *info, Limits *limits);
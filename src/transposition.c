@@ -17,70 +17,536 @@
 */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #if defined(__linux__)
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <signal.h>
     #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
 #endif
 
 #include "transposition.h"
 #include "types.h"
+#include "windows.h"
+
+int NUMAInterleave = 1;    // Set by UCI options
+char SharedHashName[256];  // Set by UCI options
+extern int LargePages;     // Defined by windows.c
 
 TTable Table; // Global Transposition Table
 static const uint64_t MB = 1ull << 20;
 
-void initTT(uint64_t megabytes) {
+// Batches from cluster workers are stored by reader threads, which may
+// still be running after a search has ended, so they are serialized
+// against anything which frees or replaces the memory of the Table
+static pthread_mutex_t ImportLock = PTHREAD_MUTEX_INITIALIZER;
+
+#if defined(TT_STATS)
+    static __thread TTStats *LocalStats; // Set for each search thread
+    #define TT_STAT(field) do { if (LocalStats) LocalStats->field++; } while (0)
+#else
+    #define TT_STAT(field) do { } while (0)
+#endif
+
+// Saved tables begin with a page sized header, so that the buckets
+// which follow it remain aligned when the whole file is mapped
+static const char TTFileMagic[8] = "ETHTT02";
+static const uint64_t TTFileHeaderSize = 4096;
+
+// Shared tables also begin with a page sized header. The epoch and the
+// generation of the processes using the table are kept in sync through it,
+// and the pid of the creator lets others notice when it died while setting up.
+// The last of the attached processes to leave the table removes the segment
+typedef struct TTSharedHeader {
+    char magic[8];
+    uint64_t bucketSize, buckets, epoch;
+    uint8_t generation, ready;
+    int64_t creator, attached;
+    char name[256];
+} TTSharedHeader;
+
+// Processes sharing a Table may still be searching while another starts a
+// new search and advances the generation, so their ages can drift apart by
+// a little. Entries within this many generations of our own are treated as
+// current, rather than having each process see the others' entries as stale
+static const int TTSharedAgeWindow = 2;
+
+typedef struct TTSlice {
+    uint64_t start, end;
+    int index, nthreads;
+    TTable *source;
+} TTSlice;
+
+typedef struct TTFileHeader {
+    char magic[8];
+    uint64_t bucketSize, buckets, epoch;
+    uint8_t generation;
+} TTFileHeader;
+
+static TTKey keyFromHash(uint64_t hash) {
+
+    // The low bits of the hash select the bucket, so we take the
+    // signature from the high bits, which are otherwise unused
+    return hash >> (64 - 8 * sizeof(TTKey));
+}
+
+static TTKey foldTTEntry(uint64_t data) {
+
+    // Fold the entry's data down to the width of a signature
+    if (sizeof(TTKey) == sizeof(uint32_t))
+        return (TTKey) ((data >> 0) ^ (data >> 32));
+
+    return (TTKey) ((data >> 0) ^ (data >> 16) ^ (data >> 32) ^ (data >> 48));
+}
+
+static TTEntry readTTEntry(TTBucket *bucket, int i, TTKey *key) {
+
+    // Read the data and signature once each, since another thread may be
+    // writing to the slot. The signature is verified against the data read,
+    // and against the epoch, so that entries from older epochs never match
+
+    TTEntry entry;
+    entry.data = __atomic_load_n(&bucket->slots[i].data, __ATOMIC_RELAXED);
+    *key = __atomic_load_n(&bucket->keys[i], __ATOMIC_RELAXED) ^ foldTTEntry(entry.data) ^ Table.epoch;
+    return entry;
+}
+
+static void writeTTEntry(TTBucket *bucket, int i, TTEntry entry, TTKey key) {
+    __atomic_store_n(&bucket->slots[i].data, entry.data, __ATOMIC_RELAXED);
+    __atomic_store_n(&bucket->keys[i], key ^ foldTTEntry(entry.data) ^ Table.epoch, __ATOMIC_RELAXED);
+}
+
+static int ageTT(uint8_t generation) {
+
+    // Age difference to the current search, in units of TT_MASK_BOUND + 1.
+    // The bound type in the low bits never carries into the age bits
+    const int age = (259 + Table.generation - generation) & TT_MASK_AGE;
+
+    if (   Table.shared
+        && (age <= TTSharedAgeWindow * (TT_MASK_BOUND + 1) || age >= 256 - TTSharedAgeWindow * (TT_MASK_BOUND + 1)))
+        return 0;
+
+    return age;
+}
+
+#if defined(__linux__)
+
+static void detachSharedTT(TTSharedHeader *header) {
+
+    char fname[512];
+    snprintf(fname, sizeof(fname), "/dev/shm/%s", header->name);
+
+    if (!__atomic_sub_fetch(&header->attached, 1, __ATOMIC_ACQ_REL))
+        unlink(fname);
+}
+
+#endif
+
+static void releaseTT(TTable *table) {
+
+    // Tables restored from a file, or shared, are mapped, not allocated
+#if defined(__linux__)
+    if (table->shared) detachSharedTT(table->shared);
+
+    if (table->mapping) {
+        munmap(table->mapping, table->mappingSize);
+        table->mapping = NULL, table->mappingSize = 0;
+        return;
+    }
+#endif
+
+    freePages(table->buckets, (table->hashMask + 1) * sizeof(TTBucket), table->pages);
+}
+
+static void runTTSlices(int nthreads, void *(*worker)(void*), TTable *source) {
+
+    // Split the work into a slice for each search thread,
+    // but give each worker at least a couple of megabytes
+
+    const uint64_t buckets = Table.hashMask + 1u;
+    nthreads = MAX(1, MIN(nthreads, (int) (buckets * sizeof(TTBucket) / (2 * MB))));
+
+    pthread_t pthreads[nthreads];
+    TTSlice slices[nthreads];
+
+    if (nthreads == 1) {
+        slices[0] = (TTSlice) { 0, buckets, 0, 1, source };
+        worker(&slices[0]);
+        return;
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        slices[i] = (TTSlice) { buckets * i / nthreads, buckets * (i + 1) / nthreads, i, nthreads, source };
+        pthread_create(&pthreads[i], NULL, worker, &slices[i]);
+    }
+
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(pthreads[i], NULL);
+}
+
+static void *migrateTTSlice(void *cargo) {
+
+    TTSlice *slice = (TTSlice*) cargo;
+    const TTable *old = slice->source;
+    TTKey signature;
+
+    // Bind like the search thread of the same index, so that the
+    // pages of this slice are first touched on that thread's node
+    if (slice->nthreads > 8)
+        bindThisThread(slice->index);
+
+    for (uint64_t n = slice->start; n < slice->end; n++) {
+
+        TTBucket *bucket = &Table.buckets[n];
+        memset(bucket, 0, sizeof(TTBucket));
+
+        // When growing, the entries of a new bucket can only have come from
+        // the old bucket sharing its low bits. The extra index bits of each
+        // entry were never saved, so each one is copied to every candidate
+        // bucket, and those copies which are misplaced are left to age out.
+        // When shrinking, each new bucket merges several of the old ones
+
+        for (uint64_t m = n & old->hashMask; m <= old->hashMask; m += Table.hashMask + 1) {
 
-    // Cleanup memory when resizing the table
-    if (Table.hashMask) free(Table.buckets);
+            for (int i = 0; i < TT_BUCKET_NB; i++) {
 
-    // Use a default keysize of 16 bits, which should be equal to
-    // the smallest possible hash table size, which is 2 megabytes
-    assert((1ull << 16ull) * sizeof(TTBucket) == 2 * MB);
-    uint64_t keySize = 16ull;
+                TTEntry entry = readTTEntry(&old->buckets[m], i, &signature);
+
+                // Only keep the valid entries from the current search
+                if (!(entry.generation & TT_MASK_BOUND) || ageTT(entry.generation))
+                    continue;
+
+                // Replace an empty slot, or else the shallowest
+                int replace = 0;
+                for (int j = 0; j < TT_BUCKET_NB; j++) {
+                    if (!(bucket->slots[j].generation & TT_MASK_BOUND)) { replace = j; break; }
+                    if (bucket->slots[j].depth < bucket->slots[replace].depth) replace = j;
+                }
+
+                if (    (bucket->slots[replace].generation & TT_MASK_BOUND)
+                    &&   bucket->slots[replace].depth >= entry.depth)
+                    continue;
+
+                // Signatures are independent of the bucket, and the epoch
+                // is unchanged, so the stored words are copied directly
+                bucket->slots[replace].data = entry.data;
+                bucket->keys[replace] = old->buckets[m].keys[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+#if defined(__linux__)
+
+static void unlinkStaleTT(const char *fname, const struct stat *st) {
+
+    // Remove the segment we found, but not one which another
+    // process may have since re-created under the same name
+    struct stat now;
+    if (!stat(fname, &now) && now.st_ino == st->st_ino)
+        unlink(fname);
+}
+
+static void *mapSharedTT(uint64_t buckets, uint64_t *size, int *created, int retry) {
+
+    // Segments are placed in /dev/shm, just as shm_open() would do, but
+    // we open the file ourselves, to avoid needing to link against librt.
+    // The first process creates the segment, and later ones attach to it,
+    // adopting whatever size it was created with. A segment left behind by
+    // a creator which died before finishing is removed and created again
+
+    char fname[512];
+    struct stat st;
+    void *mapping;
+
+    snprintf(fname, sizeof(fname), "/dev/shm/%s", SharedHashName);
+
+    int fd = open(fname, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if ((*created = fd != -1)) {
+
+        *size = TTFileHeaderSize + buckets * sizeof(TTBucket);
+
+        if (ftruncate(fd, *size))
+            return close(fd), unlink(fname), NULL;
+    }
+
+    else {
+
+        if ((fd = open(fname, O_RDWR)) == -1) return NULL;
+
+        // Wait for a creating process to set the size of the segment,
+        // which it does right away, so a segment still empty is stale
+        for (int i = 0; i < 100 && !fstat(fd, &st) && (uint64_t) st.st_size < TTFileHeaderSize; i++)
+            usleep(10000);
+
+        if (fstat(fd, &st)) return close(fd), NULL;
+
+        if ((uint64_t) st.st_size < TTFileHeaderSize) {
+            close(fd);
+            if (!retry) return NULL;
+            unlinkStaleTT(fname, &st);
+            return mapSharedTT(buckets, size, created, 0);
+        }
+
+        *size = st.st_size;
+    }
+
+    mapping = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping remains valid after closing
+
+    if (mapping == MAP_FAILED) {
+        if (*created) unlink(fname);
+        return NULL;
+    }
+
+    TTSharedHeader *header = (TTSharedHeader*) mapping;
+
+    if (*created) {
+        __atomic_store_n(&header->creator, (int64_t) getpid(), __ATOMIC_RELAXED);
+        return mapping;
+    }
+
+    // Wait for the creating process to finish, for as long as it is alive.
+    // The creator records its pid as soon as it maps the segment, so after
+    // a second, a missing pid or a dead creator means the segment is stale
+    for (int i = 0; i < 6000 && !__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE); i++) {
+
+        const pid_t creator = (pid_t) __atomic_load_n(&header->creator, __ATOMIC_RELAXED);
+
+        if (i >= 100 && (!creator || (kill(creator, 0) == -1 && errno == ESRCH))) {
+            munmap(mapping, *size);
+            if (!retry) return NULL;
+            unlinkStaleTT(fname, &st);
+            return mapSharedTT(buckets, size, created, 0);
+        }
+
+        usleep(10000);
+    }
+
+    if (   !__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE)
+        || memcmp(header->magic, TTFileMagic, sizeof(TTFileMagic))
+        || header->bucketSize != sizeof(TTBucket)
+        || header->buckets == 0 || (header->buckets & (header->buckets - 1))
+        || TTFileHeaderSize + header->buckets * sizeof(TTBucket) != *size)
+        return munmap(mapping, *size), NULL;
+
+    // Attach, unless the last process has just left, and is removing the
+    // segment. In that case, give it a moment, then create a new segment
+    int64_t attached = __atomic_load_n(&header->attached, __ATOMIC_ACQUIRE);
+
+    while (attached > 0 && !__atomic_compare_exchange_n(&header->attached, &attached, attached + 1,
+                                                        0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    if (attached <= 0) {
+        munmap(mapping, *size);
+        if (!retry) return NULL;
+        usleep(10000);
+        return mapSharedTT(buckets, size, created, 0);
+    }
+
+    return mapping;
+}
+
+#endif
+
+static void resizeTT(uint64_t megabytes, int nthreads) {
+
+    // Keep the existing table, if any, so that its entries may be migrated
+    TTable old = Table;
+
+    // Entries must be packed into a single word for the lockless scheme
+    static_assert(sizeof(TTEntry) == sizeof(uint64_t), "TTEntry must be 64 bits");
+    static_assert(sizeof(TTBucket) == TT_BUCKET_SIZE, "TTBucket has an unexpected size");
+    static_assert(sizeof(TTStats) == 64, "TTStats must fill a single cache line");
+
+    // Start with the keysize for the smallest
+    // possible hash table size, which is 2 megabytes
+    uint64_t keySize = 1ull;
+    while ((1ull << keySize) * sizeof(TTBucket) < 2 * MB) keySize++;
 
     // Find the largest keysize that is still within our given megabytes
     while ((1ull << keySize) * sizeof(TTBucket) <= megabytes * MB / 2) keySize++;
     assert((1ull << keySize) * sizeof(TTBucket) <= megabytes * MB);
 
-#if defined(__linux__) && !defined(__ANDROID__)
-    // On Linux systems we align on 2MB boundaries and request Huge Pages
-    Table.buckets = aligned_alloc(2 * MB, (1ull << keySize) * sizeof(TTBucket));
-    madvise(Table.buckets, (1ull << keySize) * sizeof(TTBucket), MADV_HUGEPAGE);
-#else
-    // Otherwise, we simply allocate as usual and make no requests
-    Table.buckets = malloc((1ull << keySize) * sizeof(TTBucket));
+#if defined(__linux__)
+
+    // Place the Table into a named shared memory segment if requested,
+    // falling back to a private Table when that is not possible
+
+    int created;
+    uint64_t size;
+    void *mapping;
+
+    if (SharedHashName[0] && (mapping = mapSharedTT(1ull << keySize, &size, &created, 1)) != NULL) {
+
+        TTSharedHeader *header = (TTSharedHeader*) mapping;
+
+        Table.mapping     = mapping;
+        Table.mappingSize = size;
+        Table.shared      = header;
+        Table.buckets     = (TTBucket*) ((char*) mapping + TTFileHeaderSize);
+        Table.pages       = PAGES_NORMAL;
+
+        // Join the existing Table, which we do not clear or resize
+        if (!created) {
+            Table.hashMask   = header->buckets - 1;
+            Table.epoch      = (TTKey) __atomic_load_n(&header->epoch, __ATOMIC_RELAXED);
+            Table.generation = __atomic_load_n(&header->generation, __ATOMIC_RELAXED);
+            Table.numaNodes  = 0;
+            if (old.hashMask) releaseTT(&old);
+            return;
+        }
+
+        // Fill out a new Table, and then let any other processes join
+        Table.numaNodes = NUMAInterleave ? interleaveMemory(Table.buckets, (1ull << keySize) * sizeof(TTBucket)) : 0;
+        Table.hashMask  = (1ull << keySize) - 1u;
+
+        if (old.hashMask) runTTSlices(nthreads, &migrateTTSlice, &old), releaseTT(&old);
+
+        memcpy(header->magic, TTFileMagic, sizeof(TTFileMagic));
+        snprintf(header->name, sizeof(header->name), "%s", SharedHashName);
+        header->bucketSize = sizeof(TTBucket);
+        header->buckets    = Table.hashMask + 1;
+        header->epoch      = Table.epoch;
+        header->generation = Table.generation;
+        header->attached   = 1;
+        __atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
 #endif
 
+    // Request the kind of pages set by the LargePages option, falling
+    // back to smaller pages when the system is unable to provide them
+    Table.buckets = allocPages((1ull << keySize) * sizeof(TTBucket), LargePages, &Table.pages);
+    Table.mapping = NULL, Table.mappingSize = 0, Table.shared = NULL;
+
+    // Spread the pages across all NUMA nodes before they are first touched,
+    // so that remote threads do not all contend for the memory of one node
+    Table.numaNodes = NUMAInterleave ? interleaveMemory(Table.buckets, (1ull << keySize) * sizeof(TTBucket)) : 0;
+
     // Save the lookup mask
     Table.hashMask = (1ull << keySize) - 1u;
 
-    clearTT(); // Clear the table and load everything into the cache
+    // Without an old table, clear the new one and load everything into the
+    // cache. Otherwise migrate the old entries, which also fills every bucket
+    if (!old.hashMask) clearTT(nthreads);
+    else runTTSlices(nthreads, &migrateTTSlice, &old), releaseTT(&old);
+}
+
+void initTT(uint64_t megabytes, int nthreads) {
+    pthread_mutex_lock(&ImportLock);
+    resizeTT(megabytes, nthreads);
+    pthread_mutex_unlock(&ImportLock);
+}
+
+void detachTT() {
+
+    // Leave a shared Table when exiting. Searches may still be running, so
+    // the memory is left mapped, but the segment is removed if we are last
+#if defined(__linux__)
+    if (Table.shared) detachSharedTT(Table.shared);
+#endif
 }
 
 int hashSizeMBTT() {
     return ((Table.hashMask + 1) * sizeof(TTBucket)) / MB;
 }
 
+int numaNodesTT() {
+    return Table.numaNodes;
+}
+
+int pagesTT() {
+    return Table.pages;
+}
+
+uint64_t hugePagesBackedTT() {
+    return hugePagesBacked(Table.buckets, (Table.hashMask + 1) * sizeof(TTBucket));
+}
+
+int sharedTT() {
+    return Table.shared != NULL;
+}
+
 void updateTT() {
 
     // The two LSBs are used for storing the entry bound
     // types, and the six MSBs are for storing the entry
     // age. Therefore add TT_MASK_BOUND + 1 to increment
 
+    // Shared Tables advance a common generation, and pick up any change
+    // to the epoch that was made by another process. When another process
+    // has already advanced the generation since our last search, we join
+    // its generation instead, so that concurrent searches share one age
+
+#if defined(__linux__)
+    if (Table.shared) {
+        uint8_t seen = Table.generation;
+        if (__atomic_compare_exchange_n(&Table.shared->generation, &seen, seen + TT_MASK_BOUND + 1,
+                                        0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            seen += TT_MASK_BOUND + 1;
+        Table.generation = seen;
+        Table.epoch      = (TTKey) __atomic_load_n(&Table.shared->epoch, __ATOMIC_RELAXED);
+        assert(!(Table.generation & TT_MASK_BOUND));
+        return;
+    }
+#endif
+
     Table.generation += TT_MASK_BOUND + 1;
     assert(!(Table.generation & TT_MASK_BOUND));
 
 }
 
-void clearTT() {
+static void *clearTTSlice(void *cargo) {
+
+    TTSlice *slice = (TTSlice*) cargo;
+
+    // Bind like the search thread of the same index, so that the
+    // pages of this slice are first touched on that thread's node
+    if (slice->nthreads > 8)
+        bindThisThread(slice->index);
+
+    memset(&Table.buckets[slice->start], 0, sizeof(TTBucket) * (slice->end - slice->start));
+    return NULL;
+}
+
+void clearTT(int nthreads) {
+
+    // Wipe the Table in preperation for a new game,
+    // splitting the work across the search threads
+    runTTSlices(nthreads, &clearTTSlice, NULL);
+}
+
+void invalidateTT() {
 
-    // Wipe the Table in preperation for a new game. The
-    // Hash Mask is known to be one less than the size
+    // Invalidate the Table in constant time for a new game. Signatures are
+    // stored XOR'ed with the epoch, so changing the epoch makes every older
+    // entry fail verification, as if the slot were empty. We also age the
+    // Table by half of a cycle, so that the replacement scheme will favour
+    // overwriting the stale entries, regardless of their depth
 
-    memset(Table.buckets, 0, sizeof(TTBucket) * (Table.hashMask + 1u));
+#if defined(__linux__)
+    if (Table.shared) {
+        Table.epoch      = (TTKey) __atomic_add_fetch(&Table.shared->epoch, 0x9E3779B97F4A7C15ull, __ATOMIC_RELAXED);
+        Table.generation = __atomic_add_fetch(&Table.shared->generation, 32 * (TT_MASK_BOUND + 1), __ATOMIC_RELAXED);
+        assert(!(Table.generation & TT_MASK_BOUND));
+        return;
+    }
+#endif
+
+    Table.epoch      += (TTKey) 0x9E3779B97F4A7C15ull;
+    Table.generation += 32 * (TT_MASK_BOUND + 1);
+    assert(!(Table.generation & TT_MASK_BOUND));
 }
 
 int hashfullTT() {
@@ -92,11 +558,15 @@ int hashfullTT() {
     // memory between the search threads.
 
     int used = 0;
+    TTKey key;
 
-    for (int i = 0; i < 1000; i++)
-        for (int j = 0; j < TT_BUCKET_NB; j++)
-            used += (Table.buckets[i].slots[j].generation & TT_MASK_BOUND) != BOUND_NONE
-                 && (Table.buckets[i].slots[j].generation & TT_MASK_AGE) == Table.generation;
+    for (int i = 0; i < 1000; i++) {
+        for (int j = 0; j < TT_BUCKET_NB; j++) {
+            TTEntry entry = readTTEntry(&Table.buckets[i], j, &key);
+            used += (entry.generation & TT_MASK_BOUND) != BOUND_NONE
+                 && !ageTT(entry.generation);
+        }
+    }
 
     return used / TT_BUCKET_NB;
 }
@@ -119,6 +589,16 @@ int valueToTT(int value, int height) {
          : value <= -TBWIN_IN_MAX ? value - height : value;
 }
 
+void attachTTStats(TTStats *stats) {
+
+    // Direct the counters of the calling thread to the given TTStats
+#if defined(TT_STATS)
+    LocalStats = stats;
+#else
+    (void) stats;
+#endif
+}
+
 void prefetchTTEntry(uint64_t hash) {
 
     TTBucket *bucket = &Table.buckets[hash & Table.hashMask];
@@ -127,22 +607,34 @@ void prefetchTTEntry(uint64_t hash) {
 
 int getTTEntry(uint64_t hash, uint16_t *move, int *value, int *eval, int *depth, int *bound) {
 
-    const uint16_t hash16 = hash >> 48;
-    TTEntry *slots = Table.buckets[hash & Table.hashMask].slots;
+    TTKey signature;
+    const TTKey key = keyFromHash(hash);
+    TTBucket *bucket = &Table.buckets[hash & Table.hashMask];
+
+    TT_STAT(probes);
 
     // Search for a matching hash signature
     for (int i = 0; i < TT_BUCKET_NB; i++) {
-        if (slots[i].hash16 == hash16) {
 
-            // Update age but retain bound type
-            slots[i].generation = Table.generation | (slots[i].generation & TT_MASK_BOUND);
+        TTEntry entry = readTTEntry(bucket, i, &signature);
+
+        if (signature == key) {
+
+            TT_STAT(hits);
+
+            // Update age but retain bound type. Avoid the write, and the
+            // contention for the cache line, when the entry is already current
+            if (ageTT(entry.generation)) {
+                entry.generation = Table.generation | (entry.generation & TT_MASK_BOUND);
+                writeTTEntry(bucket, i, entry, key);
+            }
 
             // Copy over the TTEntry and signal success
-            *move  = slots[i].move;
-            *value = slots[i].value;
-            *eval  = slots[i].eval;
-            *depth = slots[i].depth;
-            *bound = slots[i].generation & TT_MASK_BOUND;
+            *move  = entry.move;
+            *value = entry.value;
+            *eval  = entry.eval;
+            *depth = entry.depth;
+            *bound = entry.generation & TT_MASK_BOUND;
             return 1;
         }
     }
@@ -152,33 +644,186 @@ int getTTEntry(uint64_t hash, uint16_t *move, int *value, int *eval, int *depth,
 
 void storeTTEntry(uint64_t hash, uint16_t move, int value, int eval, int depth, int bound) {
 
-    int i;
-    const uint16_t hash16 = hash >> 48;
-    TTEntry *slots = Table.buckets[hash & Table.hashMask].slots;
-    TTEntry *replace = slots; // &slots[0]
+    int i, replace = 0;
+    const TTKey key = keyFromHash(hash);
+    TTBucket *bucket = &Table.buckets[hash & Table.hashMask];
+
+    TTEntry slots[TT_BUCKET_NB];
+    TTKey signatures[TT_BUCKET_NB];
+
+    // Take a verified snapshot of the bucket to work with
+    for (i = 0; i < TT_BUCKET_NB; i++)
+        slots[i] = readTTEntry(bucket, i, &signatures[i]);
 
-    // Find a matching hash, or replace using MAX(x1, x2, x3),
+    // Find a matching hash, or replace using MAX(x1, x2, ...),
     // where xN equals the depth minus 4 times the age difference
-    for (i = 0; i < TT_BUCKET_NB && slots[i].hash16 != hash16; i++)
-        if (   replace->depth - ((259 + Table.generation - replace->generation) & TT_MASK_AGE)
-            >= slots[i].depth - ((259 + Table.generation - slots[i].generation) & TT_MASK_AGE))
-            replace = &slots[i];
+    for (i = 0; i < TT_BUCKET_NB && signatures[i] != key; i++)
+        if (   slots[replace].depth - ageTT(slots[replace].generation)
+            >= slots[i].depth - ageTT(slots[i].generation))
+            replace = i;
 
     // Prefer a matching hash, otherwise score a replacement
-    replace = (i != TT_BUCKET_NB) ? &slots[i] : replace;
+    replace = (i != TT_BUCKET_NB) ? i : replace;
 
     // Don't overwrite an entry from the same position, unless we have
     // an exact bound or depth that is nearly as good as the old one
     if (   bound != BOUND_EXACT
-        && hash16 == replace->hash16
-        && depth < replace->depth - 3)
+        && key == signatures[replace]
+        && depth < slots[replace].depth - 3) {
+        TT_STAT(storesSkipped);
         return;
+    }
+
+    // Classify the write as an update, a new entry, or an eviction
+    TT_STAT(stores);
+    if (key == signatures[replace]) TT_STAT(storesSame);
+    else if (!(slots[replace].generation & TT_MASK_BOUND)) TT_STAT(storesEmpty);
+    else TT_STAT(storesEvict);
+
+    // Finally, pack the new data and write it into the replaced slot
+    TTEntry entry;
+    entry.depth      = (int8_t)depth;
+    entry.generation = (uint8_t)bound | Table.generation;
+    entry.value      = (int16_t)value;
+    entry.eval       = (int16_t)eval;
+    entry.move       = (uint16_t)move;
+    writeTTEntry(bucket, replace, entry, key);
+}
+
+int exportTTEntries(TTExport *entries, int max, int minDepth, uint64_t *cursor, uint64_t buckets) {
+
+    // Scan the next window of buckets, wrapping around the table, and
+    // collect the valid entries from the current search of at least the
+    // given depth. The cursor is left where the next scan should begin
+
+    int count = 0;
+    TTKey key;
+
+    for (uint64_t n = 0; n < buckets && count < max; n++) {
+
+        const uint64_t index = (*cursor)++ & Table.hashMask;
+
+        for (int i = 0; i < TT_BUCKET_NB && count < max; i++) {
+
+            TTEntry entry = readTTEntry(&Table.buckets[index], i, &key);
+
+            if (   !(entry.generation & TT_MASK_BOUND)
+                ||   ageTT(entry.generation)
+                ||   entry.depth < minDepth)
+                continue;
+
+            entries[count++] = (TTExport) {
+                .hash  = ((uint64_t) key << (64 - 8 * sizeof(TTKey))) | index,
+                .move  = entry.move,  .value = entry.value, .eval = entry.eval,
+                .depth = entry.depth, .bound = entry.generation & TT_MASK_BOUND,
+            };
+        }
+    }
+
+    return count;
+}
+
+void importTTEntries(TTExport *entries, int count) {
+
+    // Entries are stored as if found by our own search. Anything which
+    // could not have come from a TTEntry is dropped before storing
+
+    pthread_mutex_lock(&ImportLock);
+
+    for (int i = 0; i < count; i++)
+        if (   entries[i].bound >= BOUND_LOWER && entries[i].bound <= BOUND_EXACT
+            && entries[i].depth >= 0)
+            storeTTEntry(entries[i].hash, entries[i].move, entries[i].value,
+                         entries[i].eval, entries[i].depth, entries[i].bound);
+
+    pthread_mutex_unlock(&ImportLock);
+}
+
+int saveTT(char *fname) {
+
+    FILE *fout = fopen(fname, "wb");
+    if (fout == NULL) return 0;
+
+    // Header describes the layout, to reject mismatched builds when loading
+    char header[TTFileHeaderSize];
+    TTFileHeader *info = (TTFileHeader*) header;
+    memset(header, 0, sizeof(header));
+    memcpy(info->magic, TTFileMagic, sizeof(TTFileMagic));
+    info->bucketSize = sizeof(TTBucket);
+    info->buckets    = Table.hashMask + 1;
+    info->epoch      = Table.epoch;
+    info->generation = Table.generation;
+
+    int success = fwrite(header, sizeof(header), 1, fout) == 1
+               && fwrite(Table.buckets, sizeof(TTBucket), Table.hashMask + 1, fout) == Table.hashMask + 1;
+
+    return fclose(fout) == 0 && success;
+}
+
+int loadTT(char *fname) {
+
+    TTFileHeader info;
+
+    FILE *fin = fopen(fname, "rb");
+    if (fin == NULL) return 0;
+
+    // Verify that the saved table matches our own layout, and that the
+    // number of buckets is a power of two, which is needed for hashMask
+    if (   fread(&info, sizeof(info), 1, fin) != 1
+        || memcmp(info.magic, TTFileMagic, sizeof(TTFileMagic))
+        || info.bucketSize != sizeof(TTBucket)
+        || info.buckets == 0 || (info.buckets & (info.buckets - 1)))
+        return fclose(fin), 0;
+
+    const uint64_t size = TTFileHeaderSize + info.buckets * sizeof(TTBucket);
+
+#if defined(__linux__)
+
+    // Map a private copy of the file, so that the pages of the table are
+    // loaded on demand. Changes made by the search are never written back
+    struct stat st;
+    fclose(fin);
+
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1) return 0;
+
+    if (fstat(fd, &st) || (uint64_t) st.st_size < size)
+        return close(fd), 0;
+
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping remains valid after closing
+
+    if (mapping == MAP_FAILED) return 0;
+    madvise(mapping, size, MADV_WILLNEED);
+
+    pthread_mutex_lock(&ImportLock);
+    if (Table.hashMask) releaseTT(&Table);
+    Table.mapping     = mapping;
+    Table.mappingSize = size;
+    Table.buckets     = (TTBucket*) ((char*) mapping + TTFileHeaderSize);
+
+#else
+
+    // Otherwise, we simply read the whole table into a new allocation
+    TTBucket *buckets = malloc(info.buckets * sizeof(TTBucket));
+
+    if (   buckets == NULL
+        || fseek(fin, TTFileHeaderSize, SEEK_SET)
+        || fread(buckets, sizeof(TTBucket), info.buckets, fin) != info.buckets)
+        return free(buckets), fclose(fin), 0;
+
+    fclose(fin);
+    pthread_mutex_lock(&ImportLock);
+    if (Table.hashMask) releaseTT(&Table);
+    Table.buckets = buckets;
+
+#endif
 
-    // Finally, copy the new data into the replaced slot
-    replace->depth      = (int8_t)depth;
-    replace->generation = (uint8_t)bound | Table.generation;
-    replace->value      = (int16_t)value;
-    replace->eval       = (int16_t)eval;
-    replace->move       = (uint16_t)move;
-    replace->hash16     = (uint16_t)hash16;
+    Table.pages      = PAGES_NORMAL;
+    Table.shared     = NULL;
+    Table.hashMask   = info.buckets - 1;
+    Table.epoch      = (TTKey) info.epoch;
+    Table.generation = info.generation;
+    pthread_mutex_unlock(&ImportLock);
+    return 1;
 }
@@ -29,37 +29,111 @@ enum {
     BOUND_EXACT = 3,
 };
 
+// Buckets are 32 bytes with three slots and 16-bit signatures by default.
+// Building with -DTT_LARGE_BUCKETS selects 64 byte buckets, matching the
+// size of a cache line, with five slots and 32-bit signatures, which cuts
+// false hits at very large Hash sizes, at the cost of fewer buckets
+
+#if defined(TT_LARGE_BUCKETS)
+
+typedef uint32_t TTKey;
+
 enum {
-    TT_MASK_BOUND = 0x03,
-    TT_MASK_AGE   = 0xFC,
-    TT_BUCKET_NB  = 3,
+    TT_MASK_BOUND  = 0x03,
+    TT_MASK_AGE    = 0xFC,
+    TT_BUCKET_NB   = 5,
+    TT_BUCKET_SIZE = 64,
 };
 
+#else
+
+typedef uint16_t TTKey;
+
+enum {
+    TT_MASK_BOUND  = 0x03,
+    TT_MASK_AGE    = 0xFC,
+    TT_BUCKET_NB   = 3,
+    TT_BUCKET_SIZE = 32,
+};
+
+#endif
+
+// Each TTEntry is packed into a single 64-bit word, which can be read and
+// written atomically. The matching hash signature for the entry is kept
+// in the TTBucket, XOR'ed with a fold of the data. A torn write, where
+// the data and the signature come from different stores, will fail the
+// verification when probed and is treated as an empty slot (Hyatt & Mann)
+
 struct TTEntry {
-    int8_t depth;
-    uint8_t generation;
-    int16_t eval, value;
-    uint16_t move, hash16;
+    union {
+        struct {
+            uint16_t move;
+            int16_t value, eval;
+            int8_t depth;
+            uint8_t generation;
+        };
+        uint64_t data;
+    };
 };
 
 struct TTBucket {
     TTEntry slots[TT_BUCKET_NB];
-    uint16_t padding;
+    TTKey keys[TT_BUCKET_NB];
+    uint8_t padding[TT_BUCKET_SIZE - TT_BUCKET_NB * (sizeof(TTEntry) + sizeof(TTKey))];
 };
 
+// Building with -DTT_STATS collects counters for each search thread, to
+// be reported by the "tt stats" command and at the end of a bench. Each
+// thread writes only to its own TTStats, which fills one cache line.
+// Only the first field is aligned, since alignment given to a list of
+// fields would place each of them on a cache line of its own
+
+typedef struct TTStats {
+    ALIGN64 uint64_t probes;
+    uint64_t hits, stores, storesEmpty, storesSame, storesEvict, storesSkipped;
+} TTStats;
+
+// Entries exchanged with other processes carry the hash bits which can be
+// recovered from the bucket index and the signature. The remaining bits
+// are zero, so both sides must use the same Hash size to agree on buckets
+
+typedef struct TTExport {
+    uint64_t hash;
+    uint16_t move;
+    int16_t value, eval;
+    int8_t depth;
+    uint8_t bound;
+} TTExport;
+
 struct TTable {
     TTBucket *buckets;
     uint64_t hashMask;
     uint8_t generation;
+    TTKey epoch;
+    void *mapping;
+    uint64_t mappingSize;
+    struct TTSharedHeader *shared;
+    int numaNodes, pages;
 };
 
-void initTT(uint64_t megabytes);
+void initTT(uint64_t megabytes, int nthreads);
+void detachTT();
 int hashSizeMBTT();
+int numaNodesTT();
+int pagesTT();
+uint64_t hugePagesBackedTT();
+int sharedTT();
 void updateTT();
-void clearTT();
+void clearTT(int nthreads);
+void invalidateTT();
 int hashfullTT();
 int valueFromTT(int value, int height);
 int valueToTT(int value, int height);
+void attachTTStats(TTStats *stats);
 void prefetchTTEntry(uint64_t hash);
 int getTTEntry(uint64_t hash, uint16_t *move, int *value, int *eval, int *depth, int *bound);
 void storeTTEntry(uint64_t hash, uint16_t move, int value, int eval, int depth, int bound);
+int exportTTEntries(TTExport *entries, int max, int minDepth, uint64_t *cursor, uint64_t buckets);
+void importTTEntries(TTExport *entries, int count);
+int saveTT(char *fname);
+int loadTT(char *fname);
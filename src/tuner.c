@@ -227,9 +227,9 @@ void initTunerEntries(TEntry *entries, Thread *thread, TArray methods) {
 
         // Resolve the position to mitigate tactics
         if (QSRESOLVE) {
-            qsearch(thread, &thread->pv, -MATE, MATE, 0);
-            for (int pvidx = 0; pvidx < thread->pv.length; pvidx++)
-                applyMove(&thread->board, thread->pv.line[pvidx], &undo);
+            qsearch(thread, -MATE, MATE);
+            for (int pvidx = 0; pvidx < thread->pvtable[0].length; pvidx++)
+                applyMove(&thread->board, thread->pvtable[0].line[pvidx], &undo);
         }
 
         // Defer the set to another function
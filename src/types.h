@@ -84,6 +84,10 @@ typedef struct EvalInfo EvalInfo;
 typedef struct MovePicker MovePicker;
 typedef struct SearchInfo SearchInfo;
 typedef struct PVariation PVariation;
+typedef struct RootMove RootMove;
+typedef struct SearchFrame SearchFrame;
+typedef struct DeferredMove DeferredMove;
+typedef struct SearchStack SearchStack;
 typedef struct Thread Thread;
 typedef struct TTEntry TTEntry;
 typedef struct TTBucket TTBucket;
@@ -94,7 +98,6 @@ typedef struct UCIGoStruct UCIGoStruct;
 
 // Renamings, currently for move ordering
 
-typedef uint16_t KillerTable[MAX_PLY+1][2];
 typedef uint16_t CounterMoveTable[COLOUR_NB][PIECE_NB][SQUARE_NB];
 
 typedef int16_t HistoryTable[COLOUR_NB][SQUARE_NB][SQUARE_NB];
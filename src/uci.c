@@ -25,6 +25,7 @@
 
 #include "attacks.h"
 #include "board.h"
+#include "cluster.h"
 #include "cmdline.h"
 #include "evaluate.h"
 #include "pyrrhic/tbprobe.h"
@@ -39,11 +40,20 @@
 #include "transposition.h"
 #include "types.h"
 #include "uci.h"
+#include "windows.h"
 #include "zobrist.h"
 
 extern int ContemptDrawPenalty;   // Defined by thread.c
 extern int ContemptComplexity;    // Defined by thread.c
 extern int MoveOverhead;          // Defined by time.c
+extern int HelperSkipping;        // Defined by search.c
+extern int ABDADA;                // Defined by search.c
+extern int LargePages;            // Defined by windows.c
+extern int EvalCacheKB;           // Defined by evalcache.c
+extern int PKCacheKB;             // Defined by evalcache.c
+extern int SharedEvalCache;       // Defined by evalcache.c
+extern int NUMAInterleave;        // Defined by transposition.c
+extern char SharedHashName[256];  // Defined by transposition.c
 extern unsigned TB_PROBE_DEPTH;   // Defined by syzygy.c
 extern volatile int ABORT_SIGNAL; // Defined by search.c
 extern volatile int IS_PONDERING; // Defined by search.c
@@ -51,6 +61,11 @@ extern volatile int ANALYSISMODE; // Defined by search.c
 extern PKNetwork PKNN;            // Defined by network.c
 
 pthread_mutex_t READYLOCK = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t GOLOCK = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t GOSIGNAL = PTHREAD_COND_INITIALIZER;
+int GOPENDING = 0;
+char *LargePagesNames[] = { "Off", "Transparent", "2MB", "1GB" };
+const char *PagesObtainedNames[] = { "normal", "Transparent Huge", "2MB Huge", "1GB Huge" };
 const char *StartPosition = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
 int main(int argc, char **argv) {
@@ -66,13 +81,17 @@ int main(int argc, char **argv) {
 
     // Initialize core components of Ethereal
     initAttacks(); initMasks(); initEval();
-    initSearch(); initZobrist(); initTT(16);
+    initSearch(); initZobrist(); initTT(16, 1);
     initPKNetwork(&PKNN);
 
     // Create the UCI-board and our threads
     threads = createThreadPool(1);
     boardFromFEN(&board, StartPosition, chess960);
 
+    // Create the thread which will handle each go command
+    pthread_create(&pthreadsgo, NULL, &uciGoLoop, &uciGoStruct);
+    pthread_detach(pthreadsgo);
+
     // Handle any command line requests
     handleCommandLine(argc, argv);
 
@@ -82,7 +101,7 @@ int main(int argc, char **argv) {
     |------------|-----------------------------------------------------------------------|
     |        uci |           Outputs the engine name, authors, and all available options |
     |    isready | *           Responds with readyok when no longer searching a position |
-    | ucinewgame | *  Resets the TT and any Hueristics to ensure determinism in searches |
+    | ucinewgame | *  Invalidates the TT and resets any Hueristics to prepare for a game |
     |  setoption | *     Sets a given option and reports that the option was set if done |
     |   position | *  Sets the board position via an optional FEN and optional move list |
     |         go | *       Searches the current position with the provided time controls |
@@ -91,22 +110,39 @@ int main(int argc, char **argv) {
     |       quit |             Exits the engine and any searches by killing the UCI loop |
     |      perft |            Custom command to compute PERFT(N) of the current position |
     |      print |         Custom command to print an ASCII view of the current position |
+    |   tt stats | *         Custom command to report Transposition Table usage counters |
+    | root stats | * Custom command to report the nodes and scores of the last RootMoves |
+    |   savehash | *           Custom command to write the Transposition Table to a file |
+    |   loadhash | *         Custom command to restore a Transposition Table from a file |
+    |    ttbatch |     Custom command for a cluster worker to trade a batch of TTEntries |
     |------------|-----------------------------------------------------------------------|
     */
 
     while (getInput(str)) {
 
-        if (strEquals(str, "uci")) {
+        if (!clusterAcceptsCommand(str))
+            printf("info string %s is refused by cluster workers\n", str), fflush(stdout);
+
+        else if (strEquals(str, "uci")) {
             printf("id name Ethereal " ETHEREAL_VERSION "\n");
             printf("id author Andrew Grant, Alayan & Laldon\n");
             printf("option name Hash type spin default 16 min 2 max 131072\n");
             printf("option name Threads type spin default 1 min 1 max 2048\n");
             printf("option name MultiPV type spin default 1 min 1 max 256\n");
+            printf("option name HelperSkipping type check default false\n");
+            printf("option name ABDADA type check default false\n");
             printf("option name ContemptDrawPenalty type spin default 0 min -300 max 300\n");
             printf("option name ContemptComplexity type spin default 0 min -100 max 100\n");
             printf("option name MoveOverhead type spin default 100 min 0 max 10000\n");
             printf("option name SyzygyPath type string default <empty>\n");
             printf("option name SyzygyProbeDepth type spin default 0 min 0 max 127\n");
+            printf("option name NUMAInterleave type check default true\n");
+            printf("option name SharedHash type string default <empty>\n");
+            printf("option name ClusterNodes type string default <empty>\n");
+            printf("option name EvalCache type spin default 512 min 16 max 65536\n");
+            printf("option name SharedEvalCache type check default false\n");
+            printf("option name PKCache type spin default 1536 min 24 max 98304\n");
+            printf("option name LargePages type combo default Transparent var Off var Transparent var 2MB var 1GB\n");
             printf("option name Ponder type check default false\n");
             printf("option name AnalysisMode type check default false\n");
             printf("option name UCI_Chess960 type check default false\n");
@@ -121,19 +157,22 @@ int main(int argc, char **argv) {
 
         else if (strEquals(str, "ucinewgame")) {
             pthread_mutex_lock(&READYLOCK);
-            resetThreadPool(threads), clearTT();
+            resetThreadPool(threads), invalidateTT();
+            clusterSend(str);
             pthread_mutex_unlock(&READYLOCK);
         }
 
         else if (strStartsWith(str, "setoption")) {
             pthread_mutex_lock(&READYLOCK);
             uciSetOption(str, &threads, &multiPV, &chess960);
+            clusterSendOption(str);
             pthread_mutex_unlock(&READYLOCK);
         }
 
         else if (strStartsWith(str, "position")) {
             pthread_mutex_lock(&READYLOCK);
             uciPosition(str, &board, chess960);
+            clusterSend(str);
             pthread_mutex_unlock(&READYLOCK);
         }
 
@@ -143,8 +182,9 @@ int main(int argc, char **argv) {
             uciGoStruct.board   = &board;
             uciGoStruct.threads = threads;
             strncpy(uciGoStruct.str, str, 512);
-            pthread_create(&pthreadsgo, NULL, &uciGo, &uciGoStruct);
-            pthread_detach(pthreadsgo);
+            pthread_mutex_lock(&GOLOCK);
+            GOPENDING = 1, pthread_cond_signal(&GOSIGNAL);
+            pthread_mutex_unlock(&GOLOCK);
         }
 
         else if (strEquals(str, "ponderhit"))
@@ -161,11 +201,58 @@ int main(int argc, char **argv) {
 
         else if (strStartsWith(str, "print"))
             printBoard(&board), fflush(stdout);
+
+        else if (strEquals(str, "tt stats")) {
+            pthread_mutex_lock(&READYLOCK);
+            uciReportTTStats(threads);
+            pthread_mutex_unlock(&READYLOCK);
+        }
+
+        else if (strEquals(str, "root stats")) {
+            pthread_mutex_lock(&READYLOCK);
+            uciReportRootMoves(threads);
+            pthread_mutex_unlock(&READYLOCK);
+        }
+
+        else if (strStartsWith(str, "savehash ")) {
+            pthread_mutex_lock(&READYLOCK);
+            uciSaveHash(str + strlen("savehash "));
+            pthread_mutex_unlock(&READYLOCK);
+        }
+
+        else if (strStartsWith(str, "ttbatch "))
+            clusterExchangeBatch(atoi(str + strlen("ttbatch ")));
+
+        else if (strStartsWith(str, "loadhash ")) {
+            pthread_mutex_lock(&READYLOCK);
+            uciLoadHash(str + strlen("loadhash "));
+            pthread_mutex_unlock(&READYLOCK);
+        }
     }
 
+    detachTT();
     return 0;
 }
 
+void *uciGoLoop(void *cargo) {
+
+    // Sleep until the UCI loop has a go command for us, and then
+    // run the search. The UCIGoStruct is filled out before waking
+
+    while (1) {
+
+        pthread_mutex_lock(&GOLOCK);
+        while (!GOPENDING)
+            pthread_cond_wait(&GOSIGNAL, &GOLOCK);
+        GOPENDING = 0;
+        pthread_mutex_unlock(&GOLOCK);
+
+        uciGo(cargo);
+    }
+
+    return NULL;
+}
+
 void *uciGo(void *cargo) {
 
     // Get our starting time as soon as possible
@@ -185,8 +272,7 @@ void *uciGo(void *cargo) {
     Thread *threads = ((UCIGoStruct*)cargo)->threads;
 
     uint16_t moves[MAX_MOVES];
-    int size = genAllLegalMoves(board, moves);
-    int idx = 0, searchmoves = 0;
+    int size = 0, idx = 0, searchmoves = 0;
 
     // Reset global signals
     IS_PONDERING = 0;
@@ -207,6 +293,9 @@ void *uciGo(void *cargo) {
 
         if (strEquals(ptr, "infinite"   )) infinite = 1;
         if (strEquals(ptr, "searchmoves")) searchmoves = 1;
+
+        // Legal moves are only needed to match those given by searchmoves
+        if (strEquals(ptr, "searchmoves")) size = genAllLegalMoves(board, moves);
         if (strEquals(ptr, "ponder"     )) IS_PONDERING = 1;
 
         for (int i = 0; i < size; i++) {
@@ -230,8 +319,8 @@ void *uciGo(void *cargo) {
     limits.inc   = (board->turn == WHITE) ?  winc :  binc;
     limits.mtg   = (board->turn == WHITE) ?   mtg :   mtg;
 
-    // Cap our MultiPV search based on the suggested or legal moves
-    limits.multiPV = MIN(multiPV, searchmoves ? idx : size);
+    // MultiPV is capped by the search, based on the moves it has to search
+    limits.multiPV = multiPV;
 
     // Execute search, return best and ponder moves
     getBestMove(threads, board, &limits, &bestMove, &ponderMove);
@@ -241,16 +330,15 @@ void *uciGo(void *cargo) {
 
     // Report best move ( we should always have one )
     moveToString(bestMove, moveStr, board->chess960);
-    printf("bestmove %s ", moveStr);
 
-    // Report ponder move ( if we have one )
-    if (ponderMove != NONE_MOVE) {
-        moveToString(ponderMove, moveStr, board->chess960);
-        printf("ponder %s", moveStr);
-    }
+    // Report ponder move ( if we have one ), in the same write
+    char ponderStr[6] = "";
+    if (ponderMove != NONE_MOVE)
+        moveToString(ponderMove, ponderStr, board->chess960);
 
     // Make sure this all gets reported
-    printf("\n"); fflush(stdout);
+    printf("bestmove %s %s%s\n", moveStr, ponderMove != NONE_MOVE ? "ponder " : "", ponderStr);
+    fflush(stdout);
 
     // Drop the ready lock, as we are prepared to handle a new search
     pthread_mutex_unlock(&READYLOCK);
@@ -264,22 +352,33 @@ void uciSetOption(char *str, Thread **threads, int *multiPV, int *chess960) {
     //  Hash                : Size of the Transposition Table in Megabyes
     //  Threads             : Number of search threads to use
     //  MultiPV             : Number of search lines to report per iteration
+    //  HelperSkipping      : Have helper threads skip depths to diversify the search
+    //  ABDADA              : Have threads defer moves being searched by other threads
     //  ContemptDrawPenalty : Evaluation bonus in internal units to avoid forced draws
     //  ContemptComplexity  : Evaluation bonus for keeping a position with more non-pawn material
     //  MoveOverhead        : Overhead on time allocation to avoid time losses
     //  SyzygyPath          : Path to Syzygy Tablebases
     //  SyzygyProbeDepth    : Minimal Depth to probe the highest cardinality Tablebase
+    //  NUMAInterleave      : Spread the Transposition Table across all NUMA nodes
+    //  SharedHash          : Name of a shared memory Transposition Table for several processes
+    //  ClusterNodes        : List of host:port worker processes to search alongside
+    //  EvalCache           : Size of each Thread's Evaluation Cache in Kilobytes
+    //  SharedEvalCache     : Use one Evaluation Cache, sized for all Threads, between them
+    //  PKCache             : Size of each Thread's Pawn King Cache in Kilobytes
+    //  LargePages          : Kind of pages to request for the Table and Threads
     //  UCI_Chess960        : Set when playing FRC, but not required in order to work
 
     if (strStartsWith(str, "setoption name Hash value ")) {
         int megabytes = atoi(str + strlen("setoption name Hash value "));
-        initTT(megabytes); printf("info string set Hash to %dMB\n", hashSizeMBTT());
+        initTT(megabytes, (*threads)->nthreads); printf("info string set Hash to %dMB\n", hashSizeMBTT());
+        uciReportHashLayout();
     }
 
     if (strStartsWith(str, "setoption name Threads value ")) {
         int nthreads = atoi(str + strlen("setoption name Threads value "));
-        free(*threads); *threads = createThreadPool(nthreads);
+        deleteThreadPool(*threads); *threads = createThreadPool(nthreads);
         printf("info string set Threads to %d\n", nthreads);
+        uciReportThreads(*threads);
     }
 
     if (strStartsWith(str, "setoption name MultiPV value ")) {
@@ -287,6 +386,22 @@ void uciSetOption(char *str, Thread **threads, int *multiPV, int *chess960) {
         printf("info string set MultiPV to %d\n", *multiPV);
     }
 
+    if (strStartsWith(str, "setoption name HelperSkipping value ")) {
+        if (strStartsWith(str, "setoption name HelperSkipping value true"))
+            printf("info string set HelperSkipping to true\n"), HelperSkipping = 1;
+        if (strStartsWith(str, "setoption name HelperSkipping value false"))
+            printf("info string set HelperSkipping to false\n"), HelperSkipping = 0;
+    }
+
+    if (strStartsWith(str, "setoption name ABDADA value ")) {
+        int nthreads = (*threads)->nthreads;
+        if (strStartsWith(str, "setoption name ABDADA value true"))
+            printf("info string set ABDADA to true\n"), ABDADA = 1;
+        if (strStartsWith(str, "setoption name ABDADA value false"))
+            printf("info string set ABDADA to false\n"), ABDADA = 0;
+        deleteThreadPool(*threads); *threads = createThreadPool(nthreads);
+    }
+
     if (strStartsWith(str, "setoption name ContemptDrawPenalty value ")){
         ContemptDrawPenalty = atoi(str + strlen("setoption name ContemptDrawPenalty value "));
         printf("info string set ContemptDrawPenalty to %d\n", ContemptDrawPenalty);
@@ -319,6 +434,77 @@ void uciSetOption(char *str, Thread **threads, int *multiPV, int *chess960) {
             printf("info string set AnalysisMode to false\n"), ANALYSISMODE = 0;
     }
 
+    if (strStartsWith(str, "setoption name NUMAInterleave value ")) {
+        if (strStartsWith(str, "setoption name NUMAInterleave value true"))
+            printf("info string set NUMAInterleave to true\n"), NUMAInterleave = 1;
+        if (strStartsWith(str, "setoption name NUMAInterleave value false"))
+            printf("info string set NUMAInterleave to false\n"), NUMAInterleave = 0;
+        initTT(hashSizeMBTT(), (*threads)->nthreads); uciReportHashLayout();
+    }
+
+    if (strStartsWith(str, "setoption name SharedHash value ")) {
+
+        char *ptr = str + strlen("setoption name SharedHash value ");
+
+        // Segment names may not contain paths, and <empty> disables sharing
+        if (!strcmp(ptr, "<empty>") || strchr(ptr, '/') || strlen(ptr) >= sizeof(SharedHashName))
+            SharedHashName[0] = '\0';
+        else strcpy(SharedHashName, ptr);
+
+        printf("info string set SharedHash to %s\n", SharedHashName[0] ? SharedHashName : "<empty>");
+        initTT(hashSizeMBTT(), (*threads)->nthreads); uciReportHashLayout();
+    }
+
+    if (strStartsWith(str, "setoption name ClusterNodes value ")) {
+        char *ptr = str + strlen("setoption name ClusterNodes value ");
+        int nodes = clusterConnect(strEquals(ptr, "<empty>") ? "" : ptr, hashSizeMBTT());
+        printf("info string set ClusterNodes to %s\n", ptr);
+        printf("info string Cluster connected to %d workers\n", nodes);
+    }
+
+    if (strStartsWith(str, "setoption name LargePages value ")) {
+
+        char *ptr = str + strlen("setoption name LargePages value ");
+
+        for (int i = PAGES_NORMAL; i <= PAGES_1GB; i++)
+            if (strStartsWith(ptr, LargePagesNames[i]))
+                printf("info string set LargePages to %s\n", ptr), LargePages = i;
+
+        // Reallocate everything using the new kind of pages. The Table goes
+        // first, so that it is not left short of the pages reserved for it
+        int nthreads = (*threads)->nthreads;
+        deleteThreadPool(*threads);
+        initTT(hashSizeMBTT(), nthreads); uciReportHashLayout();
+        *threads = createThreadPool(nthreads);
+        uciReportThreads(*threads);
+    }
+
+    if (strStartsWith(str, "setoption name EvalCache value ")) {
+        int nthreads = (*threads)->nthreads;
+        EvalCacheKB = atoi(str + strlen("setoption name EvalCache value "));
+        deleteThreadPool(*threads); *threads = createThreadPool(nthreads);
+        printf("info string set EvalCache to %dKB\n", EvalCacheKB);
+        uciReportThreads(*threads);
+    }
+
+    if (strStartsWith(str, "setoption name SharedEvalCache value ")) {
+        int nthreads = (*threads)->nthreads;
+        if (strStartsWith(str, "setoption name SharedEvalCache value true"))
+            printf("info string set SharedEvalCache to true\n"), SharedEvalCache = 1;
+        if (strStartsWith(str, "setoption name SharedEvalCache value false"))
+            printf("info string set SharedEvalCache to false\n"), SharedEvalCache = 0;
+        deleteThreadPool(*threads); *threads = createThreadPool(nthreads);
+        uciReportThreads(*threads);
+    }
+
+    if (strStartsWith(str, "setoption name PKCache value ")) {
+        int nthreads = (*threads)->nthreads;
+        PKCacheKB = atoi(str + strlen("setoption name PKCache value "));
+        deleteThreadPool(*threads); *threads = createThreadPool(nthreads);
+        printf("info string set PKCache to %dKB\n", PKCacheKB);
+        uciReportThreads(*threads);
+    }
+
     if (strStartsWith(str, "setoption name UCI_Chess960 value ")) {
         if (strStartsWith(str, "setoption name UCI_Chess960 value true"))
             printf("info string set UCI_Chess960 to true\n"), *chess960 = 1;
@@ -380,6 +566,187 @@ void uciPosition(char *str, Board *board, int chess960) {
     }
 }
 
+static const char *pagesObtained(char *str, int pages, uint64_t backed, uint64_t size) {
+
+    // Transparent Huge Pages may silently fall back to normal pages, so
+    // we report how much of the already touched memory they really back
+
+    if (pages != PAGES_TRANSPARENT)
+        return PagesObtainedNames[pages];
+
+    if (!backed || backed >= size)
+        return PagesObtainedNames[backed ? PAGES_TRANSPARENT : PAGES_NORMAL];
+
+    sprintf(str, "%s pages for %d%%, and normal",
+        PagesObtainedNames[PAGES_TRANSPARENT], (int) (100 * backed / size));
+    return str;
+}
+
+void uciReportHashLayout() {
+
+    char str[128];
+    const uint64_t size = (uint64_t) hashSizeMBTT() << 20;
+    const int pages = pagesTT();
+
+    printf("info string Hash using %s pages\n",
+        pagesObtained(str, pages, pages == PAGES_TRANSPARENT ? hugePagesBackedTT() : 0, size));
+
+    if (sharedTT())
+        printf("info string Hash of %dMB shared through /dev/shm/%s\n", hashSizeMBTT(), SharedHashName);
+    else if (SharedHashName[0])
+        printf("info string Hash unable to use /dev/shm/%s, using a private Table\n", SharedHashName);
+
+    // Single node systems have only the one possible layout
+    if (numaNodeCount() <= 1) return;
+
+    if (numaNodesTT() > 1)
+        printf("info string Hash interleaved across %d NUMA nodes\n", numaNodesTT());
+    else
+        printf("info string Hash placed by first touch on %d NUMA nodes\n", numaNodeCount());
+}
+
+void uciReportThreads(Thread *threads) {
+
+    // Report the memory used by the Threads, of which the caches are the
+    // only parts that are configurable, and the only parts which may use
+    // Huge Pages. Sizes are those allocated, after rounding to whole pages.
+    // With a shared EvalCache, the last Thread is one which refers to it
+
+    const uint64_t evsize = (threads->evmask + 1) * sizeof(EvalEntry);
+    const uint64_t pksize = (threads->pkmask + 1) * sizeof(PKEntry);
+    const int shared = threads->nthreads > 1 && threads->pool[1]->evshared;
+    Thread *const last = threads->pool[threads->nthreads - 1];
+    const int pages = threads->cachePages;
+    char str[128];
+
+    uint64_t caches = 0ull;
+    for (int i = 0; i < threads->nthreads; i++)
+        caches += evalCachesBytes(threads->pool[i]);
+
+    const char *obtained = pagesObtained(str, pages,
+        pages == PAGES_TRANSPARENT ? hugePagesBackedThreadPool(threads) : 0, caches);
+
+    printf("info string Threads of %dKB each, with a %s%dKB EvalCache and a %dKB PKCache using %s pages, %dMB in total\n",
+        (int) ((threadBytes(last) + evalCachesBytes(last)) / 1024), shared ? "shared " : "",
+        (int) (evsize / 1024), (int) (pksize / 1024), obtained, (int) (memoryThreadPool(threads) >> 20));
+}
+
+void uciReportTTStats(Thread *threads) {
+
+#if defined(TT_STATS)
+
+    // Sum the counters of each thread, which are
+    // collected since the last ucinewgame command
+
+    TTStats total = {0};
+
+    for (int i = 0; i < threads->nthreads; i++) {
+        total.probes        += threads->pool[i]->ttstats.probes;
+        total.hits          += threads->pool[i]->ttstats.hits;
+        total.stores        += threads->pool[i]->ttstats.stores;
+        total.storesEmpty   += threads->pool[i]->ttstats.storesEmpty;
+        total.storesSame    += threads->pool[i]->ttstats.storesSame;
+        total.storesEvict   += threads->pool[i]->ttstats.storesEvict;
+        total.storesSkipped += threads->pool[i]->ttstats.storesSkipped;
+    }
+
+    const double probes = MAX(1, total.probes);
+    const double writes = MAX(1, total.stores + total.storesSkipped);
+
+    printf("info string tt probes %"PRIu64" hits %"PRIu64" (%.2f%%) misses %"PRIu64" (%.2f%%)\n",
+        total.probes, total.hits, 100.0 * total.hits / probes,
+        total.probes - total.hits, 100.0 * (total.probes - total.hits) / probes);
+
+    printf("info string tt stores %"PRIu64" empty %"PRIu64" (%.2f%%) same %"PRIu64" (%.2f%%) "
+           "evict %"PRIu64" (%.2f%%) skipped %"PRIu64" (%.2f%%)\n", total.stores,
+        total.storesEmpty, 100.0 * total.storesEmpty / writes,
+        total.storesSame, 100.0 * total.storesSame / writes,
+        total.storesEvict, 100.0 * total.storesEvict / writes,
+        total.storesSkipped, 100.0 * total.storesSkipped / writes);
+
+    printf("info string tt hashfull %d size %dMB\n", hashfullTT(), hashSizeMBTT());
+
+#else
+
+    (void) threads;
+    printf("info string tt stats requires a build with -DTT_STATS\n");
+
+#endif
+
+    fflush(stdout);
+}
+
+void uciReportRootMoves(Thread *threads) {
+
+    // Report the RootMoves of the last search, in order of the nodes spent
+    // on them across all of the Threads. Scores and PVs are those found by
+    // the main thread, in its last iteration and the one before that. Moves
+    // which never raised alpha, other than the first searched, have no score
+
+    int order[MAX_MOVES];
+    uint64_t nodes[MAX_MOVES], total = 0ull;
+    const int count = threads->rootMoveCount;
+
+    for (int i = 0; i < count; i++) {
+
+        nodes[i] = 0ull;
+
+        for (int j = 0; j < threads->nthreads; j++) {
+            RootMove *rootMove = findRootMove(threads->pool[j], threads->rootMoves[i].move);
+            nodes[i] += rootMove != NULL ? rootMove->nodes : 0ull;
+        }
+
+        // Insertion sort, by the nodes spent on each move
+        int k = i; total += nodes[i];
+        for (; k > 0 && nodes[order[k-1]] < nodes[i]; k--)
+            order[k] = order[k-1];
+        order[k] = i;
+    }
+
+    for (int i = 0; i < count; i++) {
+
+        RootMove *const rootMove = &threads->rootMoves[order[i]];
+        char moveStr[6], pvStr[ROOT_PV_LENGTH * 6 + 1] = "", scoreStr[16] = "none", previousStr[16] = "none";
+
+        if (rootMove->score != -MATE)
+            sprintf(scoreStr, "%d", rootMove->score);
+
+        if (rootMove->previousScore != -MATE)
+            sprintf(previousStr, "%d", rootMove->previousScore);
+
+        for (int j = 0; j < rootMove->pvLength; j++) {
+            moveToString(rootMove->pv[j], moveStr, threads->board.chess960);
+            strcat(strcat(pvStr, moveStr), " ");
+        }
+
+        moveToString(rootMove->move, moveStr, threads->board.chess960);
+        printf("info string root %s nodes %"PRIu64" (%.2f%%) score %s previous %s pv %s\n",
+            moveStr, nodes[order[i]], 100.0 * nodes[order[i]] / MAX(1, total), scoreStr, previousStr, pvStr);
+    }
+
+    fflush(stdout);
+}
+
+void uciSaveHash(char *fname) {
+
+    if (saveTT(fname))
+        printf("info string saved Hash (%dMB) to %s\n", hashSizeMBTT(), fname);
+    else
+        printf("info string failed to save Hash to %s\n", fname);
+
+    fflush(stdout);
+}
+
+void uciLoadHash(char *fname) {
+
+    if (loadTT(fname))
+        printf("info string loaded Hash (%dMB) from %s\n", hashSizeMBTT(), fname);
+    else
+        printf("info string failed to load Hash from %s\n", fname);
+
+    fflush(stdout);
+}
+
 void uciReport(Thread *threads, int alpha, int beta, int value) {
 
     // Gather all of the statistics that the UCI protocol would be
@@ -407,19 +774,19 @@ void uciReport(Thread *threads, int alpha, int beta, int value) {
     char *bound = bounded >=  beta ? " lowerbound "
                 : bounded <= alpha ? " upperbound " : " ";
 
-    printf("info depth %d seldepth %d multipv %d score %s %d%stime %d "
-           "nodes %"PRIu64" nps %d tbhits %"PRIu64" hashfull %d pv ",
-           depth, seldepth, multiPV, type, score, bound, elapsed, nodes, nps, tbhits, hashfull);
-
-    // Iterate over the PV and print each move
-    for (int i = 0; i < threads->pv.length; i++) {
+    // Iterate over the PV and collect each move, so that the report is
+    // sent with a single write, and is never split by other output
+    char pvStr[MAX_PLY * 6 + 1] = "";
+    for (int i = 0; i < threads->pvtable[0].length; i++) {
         char moveStr[6];
-        moveToString(threads->pv.line[i], moveStr, threads->board.chess960);
-        printf("%s ", moveStr);
+        moveToString(threads->pvtable[0].line[i], moveStr, threads->board.chess960);
+        strcat(strcat(pvStr, moveStr), " ");
     }
 
-    // Send out a newline and flush
-    puts(""); fflush(stdout);
+    printf("info depth %d seldepth %d multipv %d score %s %d%stime %d "
+           "nodes %"PRIu64" nps %d tbhits %"PRIu64" hashfull %d pv %s\n",
+           depth, seldepth, multiPV, type, score, bound, elapsed, nodes, nps, tbhits, hashfull, pvStr);
+    fflush(stdout);
 }
 
 void uciReportCurrentMove(Board *board, uint16_t move, int currmove, int depth) {
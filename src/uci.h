@@ -35,7 +35,7 @@
 struct Limits {
     double start, time, inc, mtg, timeLimit;
     int limitedByNone, limitedByTime, limitedBySelf;
-    int limitedByDepth, limitedByMoves, depthLimit, multiPV;
+    int limitedByDepth, limitedByMoves, depthLimit, multiPV, silent;
     uint16_t searchMoves[MAX_MOVES], excludedMoves[MAX_MOVES];
 };
 
@@ -46,9 +46,16 @@ struct UCIGoStruct {
     Thread *threads;
 };
 
+void *uciGoLoop(void *cargo);
 void *uciGo(void *cargo);
 void uciSetOption(char *str, Thread **threads, int *multiPV, int *chess960);
 void uciPosition(char *str, Board *board, int chess960);
+void uciReportHashLayout();
+void uciReportThreads(Thread *threads);
+void uciReportTTStats(Thread *threads);
+void uciReportRootMoves(Thread *threads);
+void uciSaveHash(char *fname);
+void uciLoadHash(char *fname);
 
 void uciReport(Thread *threads, int alpha, int beta, int value);
 void uciReportCurrentMove(Board *board, uint16_t move, int currmove, int depth);
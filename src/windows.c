@@ -21,14 +21,309 @@
 #pragma GCC diagnostic ignored "-Wcast-function-type"
 #endif
 
+// Needed for the Linux thread affinity API
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+
 #include "windows.h"
 
-#ifndef _WIN32
+int LargePages = PAGES_TRANSPARENT; // Set by UCI options
 
-void bindThisThread(int index) { (void)index; };
+#if defined(__linux__) && !defined(__ANDROID__)
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+enum { MPOL_INTERLEAVE = 3, MAX_NUMA_NODES = 1024, MAX_CPUS = 4096 };
+
+static int NodeIds[MAX_NUMA_NODES], NodeCount;    // Online NUMA nodes we may use
+static cpu_set_t NodeCpus[MAX_NUMA_NODES];         // Allowed cpus of each node
+static int ThreadNodes[MAX_CPUS], ThreadNodeCount; // Node for each thread index
+static pthread_once_t TopologyOnce = PTHREAD_ONCE_INIT;
+
+static int parseRangeList(const char *fname, int *values, int max) {
+
+    // Linux describes sets of nodes and cpus with lists of ranges, such
+    // as "0-3,8-11". Read one of those files, and expand the ranges
+
+    int count = 0, first, last;
+    char buffer[4096], *ptr = buffer;
+
+    FILE *fin = fopen(fname, "r");
+    if (fin == NULL) return 0;
+
+    if (fgets(buffer, sizeof(buffer), fin) == NULL)
+        return fclose(fin), 0;
+
+    fclose(fin);
+
+    while (sscanf(ptr, "%d", &first) == 1) {
+
+        // Ranges may also be a single value
+        last = first;
+        while (*ptr >= '0' && *ptr <= '9') ptr++;
+        if (*ptr == '-' && sscanf(++ptr, "%d", &last) == 1)
+            while (*ptr >= '0' && *ptr <= '9') ptr++;
+
+        for (int i = first; i <= last && count < max; i++)
+            values[count++] = i;
+
+        if (*ptr++ != ',') break;
+    }
+
+    return count;
+}
+
+int numaNodeCount() {
+
+    int nodes[MAX_NUMA_NODES];
+    int count = parseRangeList("/sys/devices/system/node/online", nodes, MAX_NUMA_NODES);
+    return count > 0 ? count : 1;
+}
+
+int interleaveMemory(void *ptr, uint64_t size) {
+
+    // Set an interleaved memory policy for the range before any page is
+    // touched, so that pages are distributed round robin across the nodes.
+    // We make the system call ourselves, to avoid depending on libnuma
+
+    const int bits = 8 * sizeof(unsigned long);
+    unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+
+    int nodes[MAX_NUMA_NODES];
+    int count = parseRangeList("/sys/devices/system/node/online", nodes, MAX_NUMA_NODES);
+
+    if (count <= 1) return 0;
+
+    for (int i = 0; i < count; i++)
+        mask[nodes[i] / bits] |= 1ul << (nodes[i] % bits);
+
+    return !syscall(SYS_mbind, ptr, size, MPOL_INTERLEAVE, mask, MAX_NUMA_NODES, 0) ? count : 0;
+}
+
+static uint64_t pageRound(uint64_t size, int shift) {
+    return (size + (1ull << shift) - 1) & ~((1ull << shift) - 1);
+}
+
+static void* mapHugePages(uint64_t size, int shift) {
+
+    // Explicit Huge Pages are taken from the pool reserved by the system
+    // administrator, via /sys/kernel/mm/hugepages. The whole mapping is
+    // reserved up front, so an exhausted pool fails here and not later
+
+    void *ptr = mmap(NULL, pageRound(size, shift), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static int transparentHugePages() {
+
+    // Transparent Huge Pages are used after an madvise() unless disabled
+    char buffer[256] = {0};
+
+    FILE *fin = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (fin == NULL) return 0;
+
+    if (fgets(buffer, sizeof(buffer), fin) == NULL)
+        buffer[0] = '\0';
+
+    fclose(fin);
+    return buffer[0] != '\0' && strstr(buffer, "[never]") == NULL;
+}
+
+void* allocPages(uint64_t size, int request, int *obtained) {
+
+    // Work down from the largest kind of page requested, until one
+    // is available. The kind obtained is needed to free the memory
+
+    void *ptr;
+
+    if (request >= PAGES_1GB && (ptr = mapHugePages(size, 30)) != NULL)
+        return *obtained = PAGES_1GB, ptr;
+
+    if (request >= PAGES_2MB && (ptr = mapHugePages(size, 21)) != NULL)
+        return *obtained = PAGES_2MB, ptr;
+
+    // Transparent Huge Pages need the memory aligned on 2MB boundaries
+    if (   request >= PAGES_TRANSPARENT
+        && transparentHugePages()
+        && (ptr = aligned_alloc(1ull << 21, pageRound(size, 21))) != NULL) {
+
+        if (!madvise(ptr, pageRound(size, 21), MADV_HUGEPAGE))
+            return *obtained = PAGES_TRANSPARENT, ptr;
+
+        free(ptr);
+    }
+
+    // Otherwise normal pages, which need only be rounded to 4KB
+    if ((ptr = aligned_alloc(1ull << 12, pageRound(size, 12))) == NULL)
+        return NULL;
+
+    return *obtained = PAGES_NORMAL, ptr;
+}
+
+uint64_t pagesAllocated(uint64_t size, int obtained) {
+
+    // The number of bytes actually taken by allocPages()
+    return obtained == PAGES_1GB    ? pageRound(size, 30)
+         : obtained == PAGES_NORMAL ? pageRound(size, 12) : pageRound(size, 21);
+}
+
+void freePages(void *ptr, uint64_t size, int obtained) {
+
+    if (obtained == PAGES_1GB)
+        munmap(ptr, pageRound(size, 30));
+
+    else if (obtained == PAGES_2MB)
+        munmap(ptr, pageRound(size, 21));
+
+    else free(ptr);
+}
+
+uint64_t hugePagesBacked(void *ptr, uint64_t size) {
+
+    // Transparent Huge Pages are only a request, which falls back to normal
+    // pages when the kernel is unable to find them, such as when memory is
+    // fragmented. Once touched, smaps reports how much of each mapping is
+    // backed by Huge Pages, which we sum across those mappings over ptr
+
+    char line[512];
+    uint64_t start, end, kb, backed = 0;
+    const uint64_t first = (uint64_t) ptr, last = first + size;
+    int overlaps = 0;
+
+    FILE *fin = fopen("/proc/self/smaps", "r");
+    if (fin == NULL) return 0;
+
+    while (fgets(line, sizeof(line), fin) != NULL) {
+
+        if (sscanf(line, "%"SCNx64"-%"SCNx64, &start, &end) == 2)
+            overlaps = start < last && end > first;
+
+        else if (overlaps && sscanf(line, "AnonHugePages: %"SCNu64" kB", &kb) == 1)
+            backed += kb << 10;
+    }
+
+    fclose(fin);
+    return MIN(backed, size);
+}
+
+static void initTopology() {
+
+    // Linux version of bestGroup(). Count the physical cores of each node,
+    // where a core is a cpu that is the first of its SMT siblings. Then run
+    // as many threads as possible on the same node until the core limit is
+    // reached, before moving on to the next. Any threads which remain are
+    // assigned to the extra logical processors, spread across the nodes.
+    // The cpus of each node are kept, so that binding needs no file I/O.
+    // Only the cpus which the process may run on are used, since taskset,
+    // cpusets and containers can exclude some cpus, or entire nodes
+
+    char fname[256];
+    int online[MAX_NUMA_NODES], cpus[MAX_CPUS], siblings[MAX_CPUS];
+    int threads = 0, logical = 0;
+    cpu_set_t allowed;
+
+    // All threads are started by the main thread, which is never bound
+    const int restricted = !sched_getaffinity(getpid(), sizeof(allowed), &allowed);
+    const int nodes = parseRangeList("/sys/devices/system/node/online", online, MAX_NUMA_NODES);
+
+    for (int n = NodeCount = 0; n < nodes; n++) {
+
+        sprintf(fname, "/sys/devices/system/node/node%d/cpulist", online[n]);
+        int listed = parseRangeList(fname, cpus, MAX_CPUS), count = 0, cores = 0;
+
+        CPU_ZERO(&NodeCpus[NodeCount]);
+        for (int i = 0; i < listed; i++) {
+            if (cpus[i] >= CPU_SETSIZE || (restricted && !CPU_ISSET(cpus[i], &allowed))) continue;
+            CPU_SET(cpus[i], &NodeCpus[NodeCount]), cpus[count++] = cpus[i];
+        }
+
+        // Skip the nodes which the process may not run on at all
+        if (count == 0) continue;
+
+        // A core is counted once, by the first of its siblings we may use
+        for (int i = 0; i < count; i++) {
+
+            sprintf(fname, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpus[i]);
+            int first = -1, number = parseRangeList(fname, siblings, MAX_CPUS);
+
+            for (int j = 0; j < number && first == -1; j++)
+                if (siblings[j] < CPU_SETSIZE && CPU_ISSET(siblings[j], &NodeCpus[NodeCount]))
+                    first = siblings[j];
+
+            cores += first == -1 || first == cpus[i];
+        }
+
+        for (int i = 0; i < cores && threads < MAX_CPUS; i++)
+            ThreadNodes[threads++] = NodeCount;
+
+        NodeIds[NodeCount++] = online[n];
+        logical += count;
+    }
+
+    // Remaining logical processors are spread across the nodes
+    for (int t = 0; threads < MIN(logical, MAX_CPUS); t++)
+        ThreadNodes[threads++] = t % NodeCount;
+
+    ThreadNodeCount = threads;
+}
+
+void bindThisThread(int index) {
+
+    // Restrict the calling thread to the cpus of its assigned node. When we
+    // have more threads than logical processors, let the OS decide instead.
+    // Should the system refuse a binding, no further threads are bound
+
+    static int refused;
+
+    pthread_once(&TopologyOnce, initTopology);
+    if (NodeCount <= 1 || index >= ThreadNodeCount || __atomic_load_n(&refused, __ATOMIC_RELAXED)) return;
+
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &NodeCpus[ThreadNodes[index]]))
+        __atomic_store_n(&refused, 1, __ATOMIC_RELAXED);
+}
 
 #else
 
+void* allocPages(uint64_t size, int request, int *obtained) {
+    (void)request; *obtained = PAGES_NORMAL; return malloc(size);
+}
+
+void freePages(void *ptr, uint64_t size, int obtained) {
+    (void)size; (void)obtained; free(ptr);
+}
+
+uint64_t pagesAllocated(uint64_t size, int obtained) { (void)obtained; return size; }
+
+uint64_t hugePagesBacked(void *ptr, uint64_t size) { (void)ptr; (void)size; return 0; }
+
+int numaNodeCount() { return 1; }
+
+int interleaveMemory(void *ptr, uint64_t size) { (void)ptr; (void)size; return 0; }
+
+#endif
+
+#if !defined(_WIN32) && (!defined(__linux__) || defined(__ANDROID__))
+
+void bindThisThread(int index) { (void)index; };
+
+#elif defined(_WIN32)
+
 static int bestGroup(int index) {
 
     // bestGroup() retrieves logical processor information using Windows specific
@@ -110,4 +405,4 @@ void bindThisThread(int index) {
         fun3(GetCurrentThread(), &affinity, NULL);
 }
 
-#endif
\ No newline at end of file
+#endif
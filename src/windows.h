@@ -39,4 +39,14 @@ typedef int (*fun3_t) (HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 
 #endif
 
+#include <stdint.h>
+
+enum { PAGES_NORMAL, PAGES_TRANSPARENT, PAGES_2MB, PAGES_1GB };
+
 void bindThisThread(int index);
+void* allocPages(uint64_t size, int request, int *obtained);
+void freePages(void *ptr, uint64_t size, int obtained);
+uint64_t pagesAllocated(uint64_t size, int obtained);
+uint64_t hugePagesBacked(void *ptr, uint64_t size);
+int numaNodeCount();
+int interleaveMemory(void *ptr, uint64_t size);
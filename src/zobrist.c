@@ -18,6 +18,11 @@
 
 #include <stdint.h>
 
+#include "attacks.h"
+#include "bitboards.h"
+#include "board.h"
+#include "masks.h"
+#include "move.h"
 #include "types.h"
 #include "zobrist.h"
 
@@ -26,6 +31,9 @@ uint64_t ZobristEnpassKeys[FILE_NB];
 uint64_t ZobristCastleKeys[SQUARE_NB];
 uint64_t ZobristTurnKey;
 
+uint64_t CuckooKeys[CUCKOO_SIZE];
+uint16_t CuckooMoves[CUCKOO_SIZE];
+
 uint64_t rand64() {
 
     // http://vigna.di.unimi.it/ftp/papers/xorshift.pdf
@@ -57,4 +65,169 @@ void initZobrist() {
 
     // Init the Zobrist key for side to move
     ZobristTurnKey = rand64();
+
+    initCuckoo();
+}
+
+void initCuckoo() {
+
+    // Fill the cuckoo tables with every reversible move, which are the moves
+    // of non-Pawn pieces between two squares, keyed by the change they make
+    // to the hash. Moves in both directions share a key, so only one is kept.
+    // Each key may live in one of two slots, and an insertion into a full slot
+    // evicts the resident entry to its other slot, until a free slot is found
+
+    for (int type = KNIGHT; type <= KING; type++) {
+        for (int colour = WHITE; colour <= BLACK; colour++) {
+
+            const int piece = makePiece(type, colour);
+
+            for (int s1 = 0; s1 < SQUARE_NB; s1++) {
+                for (int s2 = s1 + 1; s2 < SQUARE_NB; s2++) {
+
+                    const uint64_t attacks
+                        = type == KNIGHT ? knightAttacks(s1)
+                        : type == BISHOP ? bishopAttacks(s1, 0ull)
+                        : type == ROOK   ? rookAttacks(s1, 0ull)
+                        : type == QUEEN  ? queenAttacks(s1, 0ull)
+                        :                  kingAttacks(s1);
+
+                    if (!testBit(attacks, s2)) continue;
+
+                    uint16_t move = MoveMake(s1, s2, NORMAL_MOVE);
+                    uint64_t key  = ZobristKeys[piece][s1]
+                                  ^ ZobristKeys[piece][s2]
+                                  ^ ZobristTurnKey;
+
+                    int slot = cuckooHash1(key);
+
+                    while (1) {
+
+                        uint64_t tempKey  = CuckooKeys[slot];
+                        uint16_t tempMove = CuckooMoves[slot];
+
+                        CuckooKeys[slot]  = key;  key  = tempKey;
+                        CuckooMoves[slot] = move; move = tempMove;
+
+                        if (move == NONE_MOVE) break;
+
+                        slot = slot == cuckooHash1(key)
+                             ? cuckooHash2(key) : cuckooHash1(key);
+                    }
+                }
+            }
+        }
+    }
+}
+
+uint64_t hashAfterMove(Board *board, uint16_t move) {
+
+    // Compute the hash of the position after the move, without making it,
+    // so that the search may prefetch memory for the child position. This
+    // mirrors the hash updates performed in move.c, and must agree with them
+
+    const int from = MoveFrom(move), to = MoveTo(move);
+    const int fromPiece = board->squares[from];
+    const int toPiece   = board->squares[to];
+
+    uint64_t hash = board->hash ^ ZobristTurnKey;
+    uint64_t rooks = board->castleRooks;
+
+    if (board->epSquare != -1)
+        hash ^= ZobristEnpassKeys[fileOf(board->epSquare)];
+
+    if (move == NULL_MOVE)
+        return hash;
+
+    if (MoveType(move) == NORMAL_MOVE) {
+
+        hash ^= ZobristKeys[fromPiece][from]
+              ^ ZobristKeys[fromPiece][to]
+              ^ ZobristKeys[toPiece][to];
+
+        rooks &= board->castleMasks[from] & board->castleMasks[to];
+
+        // Double pawn pushes only set the enpass square when capturable
+        if (   pieceType(fromPiece) == PAWN && (to ^ from) == 16
+            && (  board->pieces[PAWN]
+                & board->colours[!board->turn]
+                & adjacentFilesMasks(fileOf(from))
+                & (board->turn == WHITE ? RANK_4 : RANK_5)))
+            hash ^= ZobristEnpassKeys[fileOf(from)];
+    }
+
+    else if (MoveType(move) == CASTLE_MOVE) {
+
+        const int rookPiece = makePiece(ROOK, board->turn);
+
+        hash ^= ZobristKeys[fromPiece][from]
+              ^ ZobristKeys[fromPiece][castleKingTo(from, to)]
+              ^ ZobristKeys[rookPiece][to]
+              ^ ZobristKeys[rookPiece][castleRookTo(from, to)];
+
+        rooks &= board->castleMasks[from];
+    }
+
+    else if (MoveType(move) == ENPASS_MOVE) {
+
+        const int ep = to - 8 + (board->turn << 4);
+
+        hash ^= ZobristKeys[fromPiece][from]
+              ^ ZobristKeys[fromPiece][to]
+              ^ ZobristKeys[makePiece(PAWN, !board->turn)][ep];
+    }
+
+    else {
+
+        const int promoPiece = makePiece(MovePromoPiece(move), board->turn);
+
+        hash ^= ZobristKeys[fromPiece][from]
+              ^ ZobristKeys[promoPiece][to]
+              ^ ZobristKeys[toPiece][to];
+
+        rooks &= board->castleMasks[to];
+    }
+
+    // Remove the keys for any castle rooks which lost their rights
+    rooks ^= board->castleRooks;
+    while (rooks) hash ^= ZobristCastleKeys[poplsb(&rooks)];
+
+    return hash;
+}
+
+uint64_t pkhashAfterMove(Board *board, uint16_t move) {
+
+    // Compute the Pawn King hash of the position after the move,
+    // which is only changed by moving or capturing Pawns and Kings
+
+    const int from = MoveFrom(move), to = MoveTo(move);
+    const int fromPiece = board->squares[from];
+    const int toPiece   = board->squares[to];
+
+    uint64_t pkhash = board->pkhash;
+
+    if (move == NULL_MOVE)
+        return pkhash;
+
+    if (MoveType(move) == NORMAL_MOVE) {
+
+        if (pieceType(fromPiece) == PAWN || pieceType(fromPiece) == KING)
+            pkhash ^= ZobristKeys[fromPiece][from] ^ ZobristKeys[fromPiece][to];
+
+        if (pieceType(toPiece) == PAWN)
+            pkhash ^= ZobristKeys[toPiece][to];
+    }
+
+    else if (MoveType(move) == CASTLE_MOVE)
+        pkhash ^= ZobristKeys[fromPiece][from]
+                ^ ZobristKeys[fromPiece][castleKingTo(from, to)];
+
+    else if (MoveType(move) == ENPASS_MOVE)
+        pkhash ^= ZobristKeys[fromPiece][from]
+                ^ ZobristKeys[fromPiece][to]
+                ^ ZobristKeys[makePiece(PAWN, !board->turn)][to - 8 + (board->turn << 4)];
+
+    else pkhash ^= ZobristKeys[fromPiece][from];
+
+    return pkhash;
 }
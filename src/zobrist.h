@@ -22,10 +22,26 @@
 
 #include "types.h"
 
+enum { CUCKOO_SIZE = 8192 };
+
 extern uint64_t ZobristKeys[32][SQUARE_NB];
 extern uint64_t ZobristEnpassKeys[FILE_NB];
 extern uint64_t ZobristCastleKeys[SQUARE_NB];
 extern uint64_t ZobristTurnKey;
 
+extern uint64_t CuckooKeys[CUCKOO_SIZE];
+extern uint16_t CuckooMoves[CUCKOO_SIZE];
+
 uint64_t rand64();
 void initZobrist();
+void initCuckoo();
+uint64_t hashAfterMove(Board *board, uint16_t move);
+uint64_t pkhashAfterMove(Board *board, uint16_t move);
+
+static inline int cuckooHash1(uint64_t key) {
+    return key & (CUCKOO_SIZE - 1);
+}
+
+static inline int cuckooHash2(uint64_t key) {
+    return (key >> 16) & (CUCKOO_SIZE - 1);
+}